@@ -0,0 +1,758 @@
+#include "gfx.hpp"
+#include "image.hpp"
+#include "sim.hpp"
+#include "util/args.hpp"
+#include "util/util.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Benchmarks of the simulation and rendering paths, without a window.
+// Usage: bench [--grid=WxH] [--ticks=N] [--life=N] [sweep options] [suite...]
+// Suites are `cpu` (CPU kernels), `actors` (compute shader across actor counts),
+// `render` (line and splat renderers across grid sizes), `format` (throughput and
+// error of packed particle storage), `integrator` (throughput and accuracy of
+// integrators and substep counts), and `sweep` (latency distributions of ticks and
+// frames across configurations), all of them run by default.
+//
+// The sweep runs every combination of its axes, given as comma-separated lists:
+// --sweep-grids=WxH,... (default: --grid), --sweep-actors=N,... (default: 1,16,256),
+// --sweep-lives=N,... (default: --life), --sweep-backends=gl,cpu,cpu-simd (default: all).
+// With --json=FILE (or - for stdout), its results are also written there as JSON
+
+namespace {
+using sim::Resolution;
+
+struct Bench_config {
+  Resolution grid_size = {1024, 1024};
+  unsigned num_ticks = 100;
+  unsigned particle_lifetime = 200;
+  bool run_cpu_kernels = false;
+  bool run_gpu_actors = false;
+  bool run_render = false;
+  bool run_formats = false;
+  bool run_integrators = false;
+  bool run_sweep = false;
+
+  // Axes of the sweep, empty ones default to the single values above
+  std::vector<Resolution> sweep_grids;
+  std::vector<unsigned> sweep_actors = {1, 16, 256};
+  std::vector<unsigned> sweep_lifetimes;
+  std::vector<gfx::Sim_backend> sweep_backends = {
+    gfx::Sim_backend::gl,
+    gfx::Sim_backend::cpu,
+    gfx::Sim_backend::cpu_simd,
+  };
+  std::string json_path;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Bitwise equality, except that all NaNs are equal: which NaN comes out of an operation
+// depends on the order of its operands, and that is not worth matching
+bool same_bits(const sim::Particle& a, const sim::Particle& b) {
+  const float* x = &a.front.x;
+  const float* y = &b.front.x;
+  for (int i = 0; i < 4; i++) {
+    if (std::memcmp(&x[i], &y[i], sizeof(float)) != 0 && !(std::isnan(x[i]) && std::isnan(y[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Run `num_ticks` ticks of the scene with `step`, return the time spent in `step` only
+template<typename Step>
+double time_ticks(const Bench_config& cfg, Step&& step) {
+  sim::Scene scene;
+  Clock::duration total{};
+  for (unsigned tick = 0; tick < cfg.num_ticks; tick++) {
+    scene.update(tick, cfg.grid_size);
+    auto start = Clock::now();
+    step(scene.get_step_params(tick, cfg.particle_lifetime));
+    total += Clock::now() - start;
+  }
+  return std::chrono::duration<double>(total).count();
+}
+
+// ============================= CPU simulation kernels =============================
+
+// The scalar port of the shader against the vectorized kernel for each instruction set
+// this CPU supports, single-threaded and then on all threads. The vectorized kernels
+// are also checked to produce the same bits as the scalar one
+void bench_cpu_kernels(const Bench_config& cfg) {
+  const size_t num_particles = cfg.grid_size.x * cfg.grid_size.y;
+  const double particle_ticks = double(num_particles) * cfg.num_ticks;
+
+  fmt::print(
+    FMT_STRING("CPU kernels: {}x{} particles, {} ticks, lifetime {}\n"),
+    cfg.grid_size.x,
+    cfg.grid_size.y,
+    cfg.num_ticks,
+    cfg.particle_lifetime
+  );
+  fmt::print(
+    FMT_STRING("{:<16} {:>7} {:>14} {:>8}  {}\n"), "kernel", "threads", "Mparticles/s", "speedup", "result"
+  );
+
+  for (unsigned num_threads: {1u, 0u}) {
+    std::vector<sim::Particle> reference(num_particles);
+
+    sim::Cpu_simulation scalar(cfg.grid_size, num_threads);
+    const double scalar_seconds = time_ticks(cfg, [&](const sim::Step_params& params) {
+      scalar.step(reference, params);
+    });
+    const unsigned threads_used = scalar.get_num_threads();
+    fmt::print(
+      FMT_STRING("{:<16} {:>7} {:>14.2f} {:>7.2f}x  {}\n"),
+      "scalar (AoS)",
+      threads_used,
+      particle_ticks / scalar_seconds * 1e-6,
+      1.0,
+      "reference"
+    );
+
+    for (sim::Isa isa: {sim::Isa::scalar, sim::Isa::sse4_2, sim::Isa::avx2, sim::Isa::avx512}) {
+      if (!sim::is_isa_supported(isa)) {
+        continue;
+      }
+      std::vector<sim::Particle> out(num_particles);
+      sim::Simd_simulation simd(cfg.grid_size, isa, num_threads);
+      const double seconds = time_ticks(cfg, [&](const sim::Step_params& params) {
+        simd.step(params, out);
+      });
+
+      size_t num_different = 0;
+      for (size_t i = 0; i < num_particles; i++) {
+        num_different += !same_bits(out[i], reference[i]);
+      }
+
+      fmt::print(
+        FMT_STRING("{:<16} {:>7} {:>14.2f} {:>7.2f}x  {}\n"),
+        fmt::format(FMT_STRING("{} (SoA)"), sim::get_isa_name(isa)),
+        threads_used,
+        particle_ticks / seconds * 1e-6,
+        scalar_seconds / seconds,
+        num_different == 0 ? "identical" : fmt::format(FMT_STRING("{} particles differ"), num_different)
+      );
+    }
+  }
+}
+
+// ============================== GPU actor count sweep ==============================
+
+// The compute shader on an offscreen context, with 1 to 4096 actors. Each tick is a
+// dispatch over all particles; ticks are timed until the GPU is done with all of them.
+// Fewer ticks run with many actors, so that the sweep finishes on software rasterizers
+void bench_gpu_actors(const Bench_config& cfg) {
+  const size_t num_particles = cfg.grid_size.x * cfg.grid_size.y;
+  constexpr unsigned max_actors = 4096;
+
+  gfx::Config gfx_cfg;
+  gfx_cfg.headless = true;
+  gfx_cfg.screen_res_x = 128;
+  gfx_cfg.screen_res_y = 128;
+  gfx_cfg.particles_x = cfg.grid_size.x;
+  gfx_cfg.particles_y = cfg.grid_size.y;
+  gfx_cfg.particle_lifetime = cfg.particle_lifetime;
+
+  struct Result {
+    unsigned num_actors;
+    unsigned num_ticks;
+    double seconds;
+  };
+  std::vector<Result> results;
+
+  for (unsigned num_actors = 1; num_actors <= max_actors; num_actors *= 4) {
+    gfx_cfg.num_actors = num_actors;
+    gfx::Init_lock gfx_lock(gfx_cfg);
+
+    // The first dispatch may include compiling the shader for real
+    gfx::fieldviz_update();
+    gfx::wait_idle();
+
+    const unsigned num_ticks = std::clamp(cfg.num_ticks * 16 / num_actors, 2u, cfg.num_ticks);
+    auto start = Clock::now();
+    for (unsigned tick = 0; tick < num_ticks; tick++) {
+      gfx::fieldviz_update();
+    }
+    gfx::wait_idle();
+    results.push_back({
+      .num_actors = num_actors,
+      .num_ticks = num_ticks,
+      .seconds = std::chrono::duration<double>(Clock::now() - start).count(),
+    });
+  }
+
+  fmt::print(
+    FMT_STRING("GPU actors: {}x{} particles, lifetime {}\n"),
+    cfg.grid_size.x,
+    cfg.grid_size.y,
+    cfg.particle_lifetime
+  );
+  fmt::print(FMT_STRING("{:>7} {:>6} {:>14} {:>16}\n"), "actors", "ticks", "Mparticles/s", "Ginteractions/s");
+  for (const Result& r: results) {
+    const double particle_ticks = double(num_particles) * r.num_ticks;
+    fmt::print(
+      FMT_STRING("{:>7} {:>6} {:>14.2f} {:>16.2f}\n"),
+      r.num_actors,
+      r.num_ticks,
+      particle_ticks / r.seconds * 1e-6,
+      particle_ticks * r.num_actors / r.seconds * 1e-9
+    );
+  }
+}
+
+// ================================= Renderer sweep =================================
+
+// Draw time per frame of both renderers, on grids from 256x256 up to the configured size
+void bench_render(const Bench_config& cfg) {
+  constexpr gfx::Renderer renderers[] = {gfx::Renderer::lines, gfx::Renderer::splat};
+
+  gfx::Config gfx_cfg;
+  gfx_cfg.headless = true;
+  gfx_cfg.screen_res_x = 1280;
+  gfx_cfg.screen_res_y = 720;
+  gfx_cfg.particle_lifetime = cfg.particle_lifetime;
+
+  struct Result {
+    Resolution grid_size;
+    unsigned num_frames;
+    double seconds[std::size(renderers)];
+  };
+  std::vector<Result> results;
+
+  for (Resolution grid = {256, 256}; grid.x <= cfg.grid_size.x && grid.y <= cfg.grid_size.y; grid *= 2u) {
+    const size_t num_particles = size_t{grid.x} * grid.y;
+    Result& result = results.emplace_back();
+    result.grid_size = grid;
+    result.num_frames = std::clamp(unsigned(cfg.num_ticks * (1 << 20) / num_particles), 2u, cfg.num_ticks);
+
+    for (size_t i = 0; i < std::size(renderers); i++) {
+      gfx_cfg.particles_x = grid.x;
+      gfx_cfg.particles_y = grid.y;
+      gfx_cfg.renderer = renderers[i];
+      gfx::Init_lock gfx_lock(gfx_cfg);
+
+      // Give the particles segments to draw, and get the first draw out of the way
+      gfx::fieldviz_update();
+      gfx::fieldviz_draw(true);
+      gfx::present_frame();
+      gfx::wait_idle();
+
+      auto start = Clock::now();
+      for (unsigned frame = 0; frame < result.num_frames; frame++) {
+        gfx::fieldviz_draw(true);
+        gfx::present_frame();
+      }
+      gfx::wait_idle();
+      result.seconds[i] = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+  }
+
+  fmt::print(FMT_STRING("Renderers: {}x{} pixels\n"), gfx_cfg.screen_res_x, gfx_cfg.screen_res_y);
+  fmt::print(
+    FMT_STRING("{:>11} {:>6} {:>12} {:>12} {:>9}\n"), "grid", "frames", "lines ms", "splat ms", "speedup"
+  );
+  for (const Result& r: results) {
+    const double lines_ms = r.seconds[0] / r.num_frames * 1e3;
+    const double splat_ms = r.seconds[1] / r.num_frames * 1e3;
+    fmt::print(
+      FMT_STRING("{:>11} {:>6} {:>12.3f} {:>12.3f} {:>8.2f}x\n"),
+      fmt::format(FMT_STRING("{}x{}"), r.grid_size.x, r.grid_size.y),
+      r.num_frames,
+      lines_ms,
+      splat_ms,
+      lines_ms / splat_ms
+    );
+  }
+}
+
+// =============================== Particle formats ===============================
+
+struct Position_error {
+  double mean = 0;
+  float max = 0;
+};
+
+// Between particles that are not NaN in either
+Position_error measure_error(std::span<const sim::Particle> expected, std::span<const sim::Particle> actual) {
+  Position_error result;
+  size_t num_compared = 0;
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (std::isnan(expected[i].front.x) || std::isnan(actual[i].front.x)) {
+      continue;
+    }
+    float error = glm::distance(expected[i].front, actual[i].front);
+    result.mean += error;
+    result.max = std::max(result.max, error);
+    num_compared++;
+  }
+  result.mean /= std::max<size_t>(num_compared, 1);
+  return result;
+}
+
+// The frames of `num_ticks` ticks accumulated into one image, as the app shows them
+std::vector<unsigned char> render_ticks(const gfx::Config& gfx_cfg, unsigned num_ticks) {
+  gfx::Init_lock gfx_lock(gfx_cfg);
+  for (unsigned tick = 0; tick < num_ticks; tick++) {
+    gfx::fieldviz_update();
+    gfx::fieldviz_draw(tick == 0);
+    gfx::present_frame();
+  }
+  return gfx::fieldviz_read_image();
+}
+
+// Tick throughput of each format, and how far its particles are from those of f32:
+// after one tick from the start, which is only the error of packing them, and after
+// all ticks, which is how far packed particles drift over time. What that looks like
+// is the difference of its image (the frames of all ticks, drawn apart from the timed
+// ticks) from that of f32: the mean over all channels, and the share of pixels with
+// a channel off by more than `pixel_tolerance`
+void bench_particle_formats(const Bench_config& cfg) {
+  constexpr gfx::Particle_format formats[] = {
+    gfx::Particle_format::f32,
+    gfx::Particle_format::f16,
+    gfx::Particle_format::unorm16,
+  };
+  constexpr std::string_view format_names[] = {"f32", "f16", "unorm16"};
+  constexpr int pixel_tolerance = 8;  // as in the regression tests
+
+  gfx::Config gfx_cfg;
+  gfx_cfg.headless = true;
+  gfx_cfg.screen_res_x = 512;
+  gfx_cfg.screen_res_y = 512;
+  gfx_cfg.particles_x = cfg.grid_size.x;
+  gfx_cfg.particles_y = cfg.grid_size.y;
+  gfx_cfg.particle_lifetime = cfg.particle_lifetime;
+
+  const size_t num_particles = cfg.grid_size.x * cfg.grid_size.y;
+  const unsigned num_ticks = std::max(cfg.num_ticks, 2u);
+  std::vector<sim::Particle> reference_first, reference_last;
+  std::vector<unsigned char> reference_image;
+
+  fmt::print(
+    FMT_STRING("Particle formats: {}x{} particles, {} ticks\n"), cfg.grid_size.x, cfg.grid_size.y, num_ticks
+  );
+  fmt::print(
+    FMT_STRING("{:>8} {:>6} {:>13} {:>22} {:>22} {:>16}\n"),
+    "format",
+    "bytes",
+    "Mparticles/s",
+    "1 tick: mean/max err",
+    "all: mean/max err",
+    "image: mean/over"
+  );
+  for (size_t i = 0; i < std::size(formats); i++) {
+    gfx_cfg.particle_format = formats[i];
+    std::vector<sim::Particle> first, last;
+    double seconds = 0;
+    {
+      gfx::Init_lock gfx_lock(gfx_cfg);
+
+      // The first dispatch may include compiling the shader for real
+      gfx::fieldviz_update();
+      first = gfx::fieldviz_read_particles();
+
+      auto start = Clock::now();
+      for (unsigned tick = 1; tick < num_ticks; tick++) {
+        gfx::fieldviz_update();
+      }
+      gfx::wait_idle();
+      seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      last = gfx::fieldviz_read_particles();
+    }
+    std::vector<unsigned char> rendered = render_ticks(gfx_cfg, num_ticks);
+
+    if (formats[i] == gfx::Particle_format::f32) {
+      reference_first = first;
+      reference_last = last;
+      reference_image = rendered;
+    }
+    const Position_error first_error = measure_error(reference_first, first);
+    const Position_error last_error = measure_error(reference_last, last);
+    const image::Rgb_difference image_diff = image::compare_rgb(reference_image, rendered, pixel_tolerance);
+    fmt::print(
+      FMT_STRING("{:>8} {:>6} {:>13.2f} {:>11.2e}/{:<10.2e} {:>11.2e}/{:<10.2e} {:>7.3f}/{:>7.3f}%\n"),
+      format_names[i],
+      (formats[i] == gfx::Particle_format::f32) ? 16 : 8,
+      double(num_particles) * (num_ticks - 1) / seconds * 1e-6,
+      first_error.mean,
+      first_error.max,
+      last_error.mean,
+      last_error.max,
+      image_diff.mean,
+      100.0 * image_diff.num_differing / std::max<size_t>(image_diff.num_total, 1)
+    );
+  }
+  fmt::print(
+    FMT_STRING("Errors are in grid units, which are `--spacing` pixels on the screen (2 by default)\n")
+  );
+  fmt::print(
+    FMT_STRING(
+      "Images are {}x{}, their mean difference is per channel (of 255), \"over\" is the % of pixels "
+      "with a channel off by more than {}\n"
+    ),
+    gfx_cfg.screen_res_x,
+    gfx_cfg.screen_res_y,
+    pixel_tolerance
+  );
+}
+
+// ================================== Integrators ==================================
+
+// Tick throughput of the compute shader with each integrator and number of substeps,
+// and how far its particles end up from a much finer integration of the same ticks.
+// Rows with the same number of field evaluations per tick cost about the same, the
+// difference being in how many dispatches and trips through the particle buffers
+// the same evaluations would take as separate ticks
+void bench_integrators(const Bench_config& cfg) {
+  struct Candidate {
+    sim::Integrator integrator;
+    unsigned substeps;
+  };
+  constexpr Candidate reference = {sim::Integrator::rk4, 16};
+  constexpr Candidate candidates[] = {
+    {sim::Integrator::euler, 1},
+    {sim::Integrator::euler, 2},
+    {sim::Integrator::euler, 4},
+    {sim::Integrator::euler, 8},
+    {sim::Integrator::rk2, 1},
+    {sim::Integrator::rk2, 2},
+    {sim::Integrator::rk2, 4},
+    {sim::Integrator::rk4, 1},
+    {sim::Integrator::rk4, 2},
+  };
+
+  gfx::Config gfx_cfg;
+  gfx_cfg.headless = true;
+  gfx_cfg.screen_res_x = 128;
+  gfx_cfg.screen_res_y = 128;
+  gfx_cfg.particles_x = cfg.grid_size.x;
+  gfx_cfg.particles_y = cfg.grid_size.y;
+  gfx_cfg.particle_lifetime = cfg.particle_lifetime;
+
+  const size_t num_particles = cfg.grid_size.x * cfg.grid_size.y;
+  const unsigned num_ticks = std::max(cfg.num_ticks, 2u);
+
+  // Time all ticks but the first, which may include compiling the shader for real
+  const auto run = [&](Candidate c, double* seconds) {
+    gfx_cfg.integrator = c.integrator;
+    gfx_cfg.substeps = c.substeps;
+    gfx::Init_lock gfx_lock(gfx_cfg);
+    gfx::fieldviz_update();
+    gfx::wait_idle();
+    auto start = Clock::now();
+    for (unsigned tick = 1; tick < num_ticks; tick++) {
+      gfx::fieldviz_update();
+    }
+    gfx::wait_idle();
+    *seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return gfx::fieldviz_read_particles();
+  };
+
+  double reference_seconds;
+  const std::vector<sim::Particle> expected = run(reference, &reference_seconds);
+
+  fmt::print(
+    FMT_STRING("Integrators: {}x{} particles, {} ticks, against {} x{}\n"),
+    cfg.grid_size.x,
+    cfg.grid_size.y,
+    num_ticks,
+    sim::get_integrator_name(reference.integrator),
+    reference.substeps
+  );
+  fmt::print(
+    FMT_STRING("{:>10} {:>8} {:>11} {:>13} {:>22}\n"),
+    "integrator",
+    "substeps",
+    "evaluations",
+    "Mparticles/s",
+    "mean/max error"
+  );
+  for (const Candidate& c: candidates) {
+    double seconds;
+    const std::vector<sim::Particle> actual = run(c, &seconds);
+    const Position_error error = measure_error(expected, actual);
+    fmt::print(
+      FMT_STRING("{:>10} {:>8} {:>11} {:>13.2f} {:>11.2e}/{:<10.2e}\n"),
+      sim::get_integrator_name(c.integrator),
+      c.substeps,
+      sim::get_field_evaluations(c.integrator) * c.substeps,
+      double(num_particles) * (num_ticks - 1) / seconds * 1e-6,
+      error.mean,
+      error.max
+    );
+  }
+  fmt::print(FMT_STRING("Errors are in grid units, evaluations are of the field, per particle per tick\n"));
+}
+
+// ===================================== Sweep =====================================
+
+struct Sample_stats {
+  double mean, median, p99;
+};
+
+// Percentiles are nearest-rank
+Sample_stats get_sample_stats(std::vector<double> samples) {
+  if (samples.empty()) {
+    return {0, 0, 0};
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto percentile = [&](double p) {
+    auto rank = static_cast<size_t>(std::ceil(p * samples.size()));
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+  };
+  double sum = 0;
+  for (double x: samples) {
+    sum += x;
+  }
+  return {sum / samples.size(), percentile(0.5), percentile(0.99)};
+}
+
+// With quotes, escaping what could plausibly be in a driver's name
+std::string quote_json(std::string_view s) {
+  std::string result = "\"";
+  for (char c: s) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += (c >= 0 && c < ' ') ? ' ' : c;
+  }
+  return result + '"';
+}
+
+// Latency of single ticks and frames, for every combination of the sweep axes, on an
+// offscreen context with the line renderer. An update is a tick of the simulation
+// (the compute shader, or the CPU kernels and the upload of their results), a draw is
+// a frame of lines. Each one is waited for on its own, to be timed apart from the others.
+// The first tick and frame are not sampled, as they may include compiling shaders
+void bench_sweep(const Bench_config& cfg) {
+  struct Result {
+    gfx::Sim_backend backend;
+    Resolution grid_size;
+    unsigned num_actors;
+    unsigned particle_lifetime;
+    Sample_stats update_ms, draw_ms;
+  };
+  std::vector<Result> results;
+  std::string renderer_name;
+
+  const std::vector<Resolution> grids =
+    cfg.sweep_grids.empty() ? std::vector<Resolution>{cfg.grid_size} : cfg.sweep_grids;
+  const std::vector<unsigned> lifetimes =
+    cfg.sweep_lifetimes.empty() ? std::vector<unsigned>{cfg.particle_lifetime} : cfg.sweep_lifetimes;
+
+  gfx::Config gfx_cfg;
+  gfx_cfg.headless = true;
+  gfx_cfg.screen_res_x = 1280;
+  gfx_cfg.screen_res_y = 720;
+  gfx_cfg.renderer = gfx::Renderer::lines;
+
+  fmt::print(
+    FMT_STRING("Sweep: {} ticks per configuration, ms per update and draw (mean/median/p99)\n"), cfg.num_ticks
+  );
+  fmt::print(
+    FMT_STRING("{:>8} {:>11} {:>6} {:>5} {:>26} {:>26}\n"),
+    "backend",
+    "grid",
+    "actors",
+    "life",
+    "update",
+    "draw"
+  );
+  for (Resolution grid: grids) {
+    for (unsigned num_actors: cfg.sweep_actors) {
+      for (unsigned lifetime: lifetimes) {
+        for (gfx::Sim_backend backend: cfg.sweep_backends) {
+          gfx_cfg.particles_x = grid.x;
+          gfx_cfg.particles_y = grid.y;
+          gfx_cfg.num_actors = num_actors;
+          gfx_cfg.particle_lifetime = lifetime;
+          gfx_cfg.backend = backend;
+          gfx::Init_lock gfx_lock(gfx_cfg);
+          renderer_name = gl::get_string(GL_RENDERER);
+
+          gfx::fieldviz_update();
+          gfx::fieldviz_draw(true);
+          gfx::present_frame();
+          gfx::wait_idle();
+
+          std::vector<double> update_ms, draw_ms;
+          for (unsigned tick = 0; tick < cfg.num_ticks; tick++) {
+            auto start = Clock::now();
+            gfx::fieldviz_update();
+            gfx::wait_idle();
+            auto updated = Clock::now();
+            gfx::fieldviz_draw(true);
+            gfx::present_frame();
+            gfx::wait_idle();
+            update_ms.push_back(std::chrono::duration<double, std::milli>(updated - start).count());
+            draw_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - updated).count());
+          }
+
+          const Result& r = results.emplace_back(Result{
+            .backend = backend,
+            .grid_size = grid,
+            .num_actors = num_actors,
+            .particle_lifetime = lifetime,
+            .update_ms = get_sample_stats(std::move(update_ms)),
+            .draw_ms = get_sample_stats(std::move(draw_ms)),
+          });
+          fmt::print(
+            FMT_STRING("{:>8} {:>11} {:>6} {:>5} {:>8.3f}/{:>8.3f}/{:>8.3f} {:>8.3f}/{:>8.3f}/{:>8.3f}\n"),
+            gfx::get_backend_name(backend),
+            fmt::format(FMT_STRING("{}x{}"), grid.x, grid.y),
+            num_actors,
+            lifetime,
+            r.update_ms.mean,
+            r.update_ms.median,
+            r.update_ms.p99,
+            r.draw_ms.mean,
+            r.draw_ms.median,
+            r.draw_ms.p99
+          );
+        }
+      }
+    }
+  }
+
+  if (cfg.json_path.empty()) {
+    return;
+  }
+  std::FILE* file = (cfg.json_path == "-") ? stdout : std::fopen(cfg.json_path.c_str(), "w");
+  if (!file) {
+    FATAL("Cannot write results to '{}': {}", cfg.json_path, std::strerror(errno));
+  }
+  fmt::print(
+    file,
+    FMT_STRING(
+      "{{\n  \"renderer\": {},\n  \"cpu_isa\": {},\n  \"cpu_threads\": {},\n"
+      "  \"ticks\": {},\n  \"results\": ["
+    ),
+    quote_json(renderer_name),
+    quote_json(sim::get_isa_name(sim::detect_best_isa())),
+    std::max(1u, std::thread::hardware_concurrency()),
+    cfg.num_ticks
+  );
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    const auto format_stats = [](const Sample_stats& stats) {
+      return fmt::format(
+        FMT_STRING("{{\"mean\": {:.4f}, \"median\": {:.4f}, \"p99\": {:.4f}}}"),
+        stats.mean,
+        stats.median,
+        stats.p99
+      );
+    };
+    fmt::print(
+      file,
+      FMT_STRING(
+        "{}\n    {{\"backend\": \"{}\", \"grid\": [{}, {}], \"actors\": {}, \"lifetime\": {}, "
+        "\"update_ms\": {}, \"draw_ms\": {}}}"
+      ),
+      i == 0 ? "" : ",",
+      gfx::get_backend_name(r.backend),
+      r.grid_size.x,
+      r.grid_size.y,
+      r.num_actors,
+      r.particle_lifetime,
+      format_stats(r.update_ms),
+      format_stats(r.draw_ms)
+    );
+  }
+  std::fputs("\n  ]\n}\n", file);
+
+  if (file == stdout) {
+    std::fflush(file);
+  } else if (std::fclose(file) != 0) {
+    FATAL("Cannot write results to '{}': {}", cfg.json_path, std::strerror(errno));
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  Bench_config cfg;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    try {
+      if (arg.starts_with("--grid=")) {
+        arg::parse_resolution(arg.substr(sizeof("--grid=") - 1), cfg.grid_size.x, cfg.grid_size.y);
+      } else if (arg.starts_with("--ticks=")) {
+        arg::parse_number(arg.substr(sizeof("--ticks=") - 1), cfg.num_ticks);
+      } else if (arg.starts_with("--life=")) {
+        arg::parse_number(arg.substr(sizeof("--life=") - 1), cfg.particle_lifetime);
+      } else if (arg.starts_with("--sweep-grids=")) {
+        arg::parse_list(arg.substr(sizeof("--sweep-grids=") - 1), [&](std::string_view item) {
+          Resolution& grid = cfg.sweep_grids.emplace_back();
+          arg::parse_resolution(item, grid.x, grid.y);
+        });
+      } else if (arg.starts_with("--sweep-actors=")) {
+        cfg.sweep_actors.clear();
+        arg::parse_list(arg.substr(sizeof("--sweep-actors=") - 1), [&](std::string_view item) {
+          arg::parse_number(item, cfg.sweep_actors.emplace_back());
+        });
+      } else if (arg.starts_with("--sweep-lives=")) {
+        arg::parse_list(arg.substr(sizeof("--sweep-lives=") - 1), [&](std::string_view item) {
+          arg::parse_number(item, cfg.sweep_lifetimes.emplace_back());
+        });
+      } else if (arg.starts_with("--sweep-backends=")) {
+        cfg.sweep_backends.clear();
+        arg::parse_list(arg.substr(sizeof("--sweep-backends=") - 1), [&](std::string_view item) {
+          gfx::parse_backend(item, cfg.sweep_backends.emplace_back());
+        });
+      } else if (arg.starts_with("--json=")) {
+        cfg.json_path = arg.substr(sizeof("--json=") - 1);
+      } else if (arg == "cpu") {
+        cfg.run_cpu_kernels = true;
+      } else if (arg == "actors") {
+        cfg.run_gpu_actors = true;
+      } else if (arg == "render") {
+        cfg.run_render = true;
+      } else if (arg == "format") {
+        cfg.run_formats = true;
+      } else if (arg == "integrator") {
+        cfg.run_integrators = true;
+      } else if (arg == "sweep") {
+        cfg.run_sweep = true;
+      } else {
+        throw arg::Arg_parse_exception{.subject = arg, .defect = "is not a valid option"};
+      }
+    } catch (arg::Arg_parse_exception& ex) {
+      FATAL("Bad argument '{}': '{}' {}", arg, ex.subject, ex.defect);
+    }
+  }
+
+  if (!cfg.run_cpu_kernels && !cfg.run_gpu_actors && !cfg.run_render && !cfg.run_formats
+      && !cfg.run_integrators && !cfg.run_sweep) {
+    cfg.run_cpu_kernels = cfg.run_gpu_actors = cfg.run_render = cfg.run_formats = true;
+    cfg.run_integrators = cfg.run_sweep = true;
+  }
+
+  if (cfg.run_cpu_kernels) {
+    bench_cpu_kernels(cfg);
+  }
+  if (cfg.run_gpu_actors) {
+    bench_gpu_actors(cfg);
+  }
+  if (cfg.run_render) {
+    bench_render(cfg);
+  }
+  if (cfg.run_formats) {
+    bench_particle_formats(cfg);
+  }
+  if (cfg.run_integrators) {
+    bench_integrators(cfg);
+  }
+  if (cfg.run_sweep) {
+    bench_sweep(cfg);
+  }
+}
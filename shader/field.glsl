@@ -0,0 +1,44 @@
+// The vector field: actors and the velocity they induce at a point.
+// Shared by the particle update and the field bake
+
+// Any number of actors: first `num_vortices` vortices, then `num_pushers` pushers,
+// each as (position.xy, force, unused)
+layout (std430, binding = 1) readonly buffer SSBO_actors { vec4 actors[]; };
+
+layout (location = 10) uniform uint num_vortices;
+layout (location = 11) uniform uint num_pushers;
+
+// Actors are staged through shared memory a tile at a time, so that each one is read
+// from the buffer once per workgroup instead of once per invocation.
+// Including shaders must define `group_size`, and call velocity_at in uniform control flow
+shared vec4 actor_tile[group_size];
+
+// MAX_VELOCITY is defined by the program, as sim::max_velocity
+vec2 velocity_at (vec2 p)
+{
+	vec2 vel = vec2(0);
+
+	// Linear falloff of force
+	uint num_actors = num_vortices + num_pushers;
+	for (uint tile_start = 0; tile_start < num_actors; tile_start += group_size) {
+		uint load_index = tile_start + gl_LocalInvocationIndex;
+		if (load_index < num_actors)
+			actor_tile[gl_LocalInvocationIndex] = actors[load_index];
+		barrier();
+
+		uint tile_end = min(group_size, num_actors - tile_start);
+		for (uint i = 0; i < tile_end; i++) {
+			vec4 actor = actor_tile[i];
+			vec2 r = p - actor.xy;
+			vec2 dir = (tile_start + i < num_vortices) ? vec2(-r.y, r.x) : r;
+			vel += actor.z * dir / dot(r, r);
+		}
+		barrier();
+	}
+
+	float vel2 = dot(vel,vel);
+	if (vel2 > MAX_VELOCITY * MAX_VELOCITY)
+		vel *= MAX_VELOCITY / sqrt(vel2);
+
+	return vel;
+}
@@ -0,0 +1,6 @@
+void main ()
+{
+	// One triangle that covers the whole viewport
+	vec2 position = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 4 - vec2(1);
+	gl_Position = vec4(position, 0.0, 1.0);
+}
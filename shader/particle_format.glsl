@@ -0,0 +1,44 @@
+// Particles are laid out row by row, in one of several formats, see `gfx::Particle_format`:
+// as two vec2 in four words, or with each position packed into one word, either as
+// two halves, or as two unorm16 over [unorm_origin, unorm_origin + unorm_extent].
+// The including shader provides the buffers, as arrays of uint
+
+const uint particle_format_f32 = 0;
+const uint particle_format_f16 = 1;
+const uint particle_format_unorm16 = 2;
+
+layout (location = 20) uniform uint particle_format;
+layout (location = 21) uniform vec2 unorm_origin;
+layout (location = 22) uniform vec2 unorm_extent;
+
+vec2 unpack_position (uint word)
+{
+	if (particle_format == particle_format_f16)
+		return unpackHalf2x16(word);
+	return unorm_origin + unpackUnorm2x16(word) * unorm_extent;
+}
+
+uint pack_position (vec2 p)
+{
+	if (particle_format == particle_format_f16)
+		return packHalf2x16(p);
+	return packUnorm2x16((p - unorm_origin) / unorm_extent);
+}
+
+// Where particle `id` is in the grid, from (0, 0) to (1, 1).
+// In floating point rather than with an integer division, which is slow on GPUs:
+// exact up to 2^23 particles, and at worst a row off beyond that
+vec2 get_grid_coord (uint id, uvec2 grid_size)
+{
+	float row = floor((float(id) + 0.5) / float(grid_size.x));
+	float column = float(id) - row * float(grid_size.x);
+	return vec2(column, row) / vec2(grid_size);
+}
+
+#define LOAD_FRONT(particles, id) ((particle_format == particle_format_f32) \
+	? uintBitsToFloat(uvec2(particles[4 * (id)], particles[4 * (id) + 1])) \
+	: unpack_position(particles[2 * (id)]))
+
+#define LOAD_BACK(particles, id) ((particle_format == particle_format_f32) \
+	? uintBitsToFloat(uvec2(particles[4 * (id) + 2], particles[4 * (id) + 3])) \
+	: unpack_position(particles[2 * (id) + 1]))
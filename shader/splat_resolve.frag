@@ -0,0 +1,23 @@
+out vec4 final_color;
+
+// See splat.comp
+layout (binding = 1) uniform usampler2DArray splat;
+
+// How quickly a pixel becomes opaque with the number of segments through it
+const float density_gain = 0.7;
+
+void main ()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	uint count = texelFetch(splat, ivec3(pixel, 3), 0).r;
+	if (count == 0)
+		discard;
+
+	uvec3 sum = uvec3(
+		texelFetch(splat, ivec3(pixel, 0), 0).r,
+		texelFetch(splat, ivec3(pixel, 1), 0).r,
+		texelFetch(splat, ivec3(pixel, 2), 0).r
+	);
+	vec3 color = vec3(sum) / (255.0 * float(count));
+	final_color = vec4(color, 1 - exp(-density_gain * float(count)));
+}
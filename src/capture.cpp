@@ -0,0 +1,188 @@
+#include "capture.hpp"
+#include "util/util.hpp"
+#include <cerrno>
+#include <cstring>
+
+namespace gl {
+Frame_capture::Frame_capture(
+  std::string_view path_,
+  Format format_,
+  glm::vec<2, unsigned> size_,
+  unsigned fps_
+) :
+  path{path_},
+  format{format_},
+  size{size_},
+  fps{fps_},
+  frame_bytes{3 * size_t{size_.x} * size_.y} {
+  constexpr GLbitfield map_flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT;
+  for (Slot& slot: slots) {
+    slot.pbo = Buffer::create();
+    glNamedBufferStorage(slot.pbo.get(), frame_bytes, nullptr, map_flags);
+    slot.pixels = map_buffer_range_as<std::byte>(slot.pbo, 0, frame_bytes, map_flags);
+  }
+
+  writer = std::thread([this] { writer_loop(); });
+  INFO("Capturing {}x{} frames to '{}'", size.x, size.y, path);
+}
+
+Frame_capture::~Frame_capture() {
+  // Nothing is rendered after this, so the remaining readbacks may as well be waited for
+  for (int i = 0; i < ring_size; i++) {
+    Slot& slot = slots[(next_slot + i) % ring_size];
+    if (slot.fence) {
+      try_retire(slot, true);
+    }
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    quitting = true;
+  }
+  frames_available.notify_one();
+  writer.join();
+
+  for (Slot& slot: slots) {
+    unmap_buffer(slot.pbo);
+  }
+
+  INFO("Captured {} frames to '{}', dropped {}", num_written, path, num_dropped);
+}
+
+void Frame_capture::capture(GLuint framebuffer) {
+  // Hand over whatever readbacks are done, oldest first (and they complete in order)
+  for (int i = 0; i < ring_size; i++) {
+    Slot& slot = slots[(next_slot + i) % ring_size];
+    if (slot.fence && !try_retire(slot, false)) {
+      break;
+    }
+  }
+
+  Slot& slot = slots[next_slot];
+  bool is_writing;
+  {
+    std::lock_guard lock(mutex);
+    is_writing = slot.is_writing;
+  }
+  if (slot.fence || is_writing) {
+    // The GPU is still busy with the readback from `ring_size` frames ago,
+    // or the writer with writing it out
+    num_dropped++;
+    return;
+  }
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo.get());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, size.x, size.y, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  // The mapping is not coherent, so the pixels only become visible through it with this
+  glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+  slot.fence = Sync::fence();
+  slot.frame_index = num_captured++;
+  next_slot = (next_slot + 1) % ring_size;
+}
+
+bool Frame_capture::try_retire(Slot& slot, bool wait) {
+  const GLuint64 timeout_ns = wait ? 5'000'000'000 : 0;
+  GLenum status = glClientWaitSync(slot.fence.get(), GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+  if (status == GL_TIMEOUT_EXPIRED && !wait) {
+    return false;
+  }
+  slot.fence.reset();
+  if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+    WARNING("Capture readback of frame {} did not complete, dropping it", slot.frame_index);
+    num_dropped++;
+    return true;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    slot.is_writing = true;
+    queued_slots.push_back(&slot);
+  }
+  frames_available.notify_one();
+  return true;
+}
+
+void Frame_capture::writer_loop() {
+  std::FILE* file = (path == "-") ? stdout : std::fopen(path.c_str(), "wb");
+  if (!file) {
+    WARNING("Cannot open '{}' for capture: {}", path, std::strerror(errno));
+  } else if (format == Format::y4m) {
+    fmt::print(file, FMT_STRING("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444\n"), size.x, size.y, fps);
+  }
+
+  std::vector<unsigned char> scratch;
+  while (true) {
+    Slot* slot;
+    {
+      std::unique_lock lock(mutex);
+      frames_available.wait(lock, [&] { return quitting || !queued_slots.empty(); });
+      if (queued_slots.empty()) {
+        break;
+      }
+      slot = queued_slots.front();
+      queued_slots.pop_front();
+    }
+
+    if (file) {
+      write_frame(file, slot->pixels, scratch);
+      if (std::ferror(file)) {
+        WARNING("Writing capture to '{}' failed, discarding further frames", path);
+        if (file != stdout) {
+          std::fclose(file);
+        }
+        file = nullptr;
+      }
+    }
+
+    std::lock_guard lock(mutex);
+    slot->is_writing = false;
+    num_written += (file != nullptr);
+  }
+
+  if (file == stdout) {
+    std::fflush(file);
+  } else if (file) {
+    std::fclose(file);
+  }
+}
+
+// Pixels come from glReadPixels bottom row first, and get flipped to top row first
+void Frame_capture::write_frame(
+  std::FILE* file,
+  const std::byte* frame,
+  std::vector<unsigned char>& scratch
+) const {
+  const auto* pixels = reinterpret_cast<const unsigned char*>(frame);
+  const size_t row_bytes = 3 * size_t{size.x};
+
+  if (format == Format::rgb) {
+    for (unsigned y = size.y; y-- > 0;) {
+      std::fwrite(pixels + y * row_bytes, 1, row_bytes, file);
+    }
+    return;
+  }
+
+  // BT.601 limited range, in 8-bit fixed point, as most players assume for Y4M
+  const size_t plane_bytes = size_t{size.x} * size.y;
+  scratch.resize(3 * plane_bytes);
+  unsigned char* plane_y = scratch.data();
+  unsigned char* plane_u = plane_y + plane_bytes;
+  unsigned char* plane_v = plane_u + plane_bytes;
+  size_t out = 0;
+  for (unsigned y = size.y; y-- > 0;) {
+    const unsigned char* row = pixels + y * row_bytes;
+    for (unsigned x = 0; x < size.x; x++, out++) {
+      const int r = row[3 * x], g = row[3 * x + 1], b = row[3 * x + 2];
+      plane_y[out] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+      plane_u[out] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+      plane_v[out] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+  }
+  std::fputs("FRAME\n", file);
+  std::fwrite(scratch.data(), 1, scratch.size(), file);
+}
+}  // namespace gl
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "gl.hpp"
+#include "math.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace gl {
+// Records frames from a framebuffer to a file, FIFO or stdout ("-") without stalling
+// the render thread: the pixels of each frame are read into one of a ring of pixel pack
+// buffers, mapped persistently. A few frames later, once its fence has signaled, the slot
+// is handed over to a writer thread, which converts and writes the pixels out straight
+// from the mapping (and may block on a slow pipe all it wants), then hands the slot back.
+//
+// Whenever keeping up would require a wait (the GPU has not finished a readback, or the
+// writer has not finished with the slot, by the time it comes around again), the frame is
+// dropped instead, and counted.
+//
+// Writing into a pipe whose reader went away raises SIGPIPE, which would end the program:
+// whoever captures to a pipe should ignore it (main.cpp does)
+class Frame_capture {
+public:
+  enum class Format {
+    rgb,  // raw 8-bit RGB, top row first, no header
+    y4m,  // YUV4MPEG2, 4:4:4, which ffmpeg and players understand as is
+  };
+
+  constexpr static int ring_size = 4;
+
+  Frame_capture(std::string_view path, Format, glm::vec<2, unsigned> size, unsigned fps);
+  ~Frame_capture();
+
+  Frame_capture(const Frame_capture&) = delete;
+  Frame_capture& operator=(const Frame_capture&) = delete;
+
+  // Queue a readback of the bottom left `size` pixels of the framebuffer
+  void capture(GLuint framebuffer);
+
+private:
+  struct Slot {
+    Buffer pbo;
+    const std::byte* pixels;  // mapped for as long as the capture lasts
+    Sync fence;  // non-null while the readback is in flight
+    bool is_writing = false;  // while the writer has the slot, guarded by `mutex`
+    unsigned long frame_index;
+  };
+
+  std::string path;
+  Format format;
+  glm::vec<2, unsigned> size;
+  unsigned fps;
+  size_t frame_bytes;
+
+  Slot slots[ring_size];
+  unsigned next_slot = 0;
+  unsigned long num_captured = 0;
+  unsigned long num_dropped = 0;
+
+  // Shared with the writer thread
+  std::mutex mutex;
+  std::condition_variable frames_available;
+  std::deque<Slot*> queued_slots;
+  bool quitting = false;
+  unsigned long num_written = 0;
+  std::thread writer;
+
+  // Hand the slot over to the writer if its pixels are ready (or if `wait`)
+  bool try_retire(Slot&, bool wait);
+  void writer_loop();
+  void write_frame(std::FILE*, const std::byte* pixels, std::vector<unsigned char>& scratch) const;
+};
+}  // namespace gl
@@ -1,8 +1,26 @@
 #include "gfx.hpp"
+#include "capture.hpp"
 #include "glsl.hpp"
+#include "gpu_timer.hpp"
 #include "math.hpp"
+#include "sim.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include "util/args.hpp"
 #include "util/deferred_init.hpp"
 #include "util/util.hpp"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
 
 using Resolution = glm::vec<2, unsigned>;
 
@@ -11,8 +29,82 @@ namespace gfx {
 struct Field_viz_config {
   Resolution particle_grid_size;
   unsigned particle_lifetime;
+  unsigned tick_rate;
+  sim::Integrator integrator;
+  unsigned substeps;
+  unsigned num_actors;
+  unsigned actors_ring_size;
+  Sim_backend backend;
+  Renderer renderer;
+  Particle_format particle_format;
+  Resolution field_bake_size;
+  bool field_bake_half;
+  bool validate;
+  bool gpu_timing;
+  std::string capture_path;
+  gl::Frame_capture::Format capture_format;
+  Resolution capture_size;
+  unsigned capture_fps;
+  std::string snapshot_path;
+  std::string restore_path;
+  bool autotune;
+  std::string autotune_cache_path;  // empty to not remember the results
+  std::string driver_identity;
+  bool hot_reload;
+  float frame_time_target_ms;  // for dynamic resolution, 0 for none
+  Resolution screen_size;  // to size the framebuffers for, before the first frame
 };
 
+// Workgroup sizes found by autotuning are kept in a text file, one line per renderer:
+// the size, a space, and the driver identity
+static std::optional<unsigned> load_tuned_workgroup_size(const std::string& path, std::string_view identity) {
+  if (path.empty()) {
+    return {};
+  }
+  std::ifstream file(path);
+  const std::string suffix = fmt::format(FMT_STRING(" {}"), identity);
+  for (std::string line; std::getline(file, line);) {
+    if (!line.ends_with(suffix)) {
+      continue;
+    }
+    const char* size_end = line.data() + line.size() - suffix.size();
+    unsigned size = 0;
+    auto [end, error] = std::from_chars(line.data(), size_end, size);
+    if (error == std::errc() && end == size_end) {
+      return size;
+    }
+  }
+  return {};
+}
+
+static void store_tuned_workgroup_size(const std::string& path, std::string_view identity, unsigned size) {
+  if (path.empty()) {
+    return;
+  }
+
+  // Keep the lines of other renderers
+  std::string contents;
+  {
+    std::ifstream file(path);
+    const std::string suffix = fmt::format(FMT_STRING(" {}"), identity);
+    for (std::string line; std::getline(file, line);) {
+      if (!line.ends_with(suffix)) {
+        contents += line;
+        contents += '\n';
+      }
+    }
+  }
+  contents += fmt::format(FMT_STRING("{} {}\n"), size, identity);
+
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+  const std::string temp_path = path + ".tmp";
+  std::ofstream(temp_path) << contents;
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    WARNING("Cannot save the tuned workgroup size to '{}': {}", path, std::strerror(errno));
+  }
+}
+
 // TODO: use fieldviz as a proper class and not a global resource
 static void fieldviz_init(const Field_viz_config&);
 static void fieldviz_deinit();
@@ -25,9 +117,14 @@ using Unique_SDL_GLContext = Unique_handle<SDL_GLContext, Simple_deleter<SDL_GL_
 
 struct SDL_init_lock: Singleton_lock<SDL_init_lock> {
   SDL_init_lock(const Config& cfg) {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    // Headless runs still poll SDL events (so that SIGINT arrives as SDL_QUIT),
+    // but must not touch the video subsystem, which fails without a display
+    if (SDL_Init(cfg.headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0) {
       FATAL("Failed to initialize SDL: {}", SDL_GetError());
     }
+    if (cfg.headless) {
+      return;
+    }
 
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 6);
@@ -44,44 +141,156 @@ struct SDL_init_lock: Singleton_lock<SDL_init_lock> {
   }
 };
 
+// Offscreen replacement for the window and its GL context, for machines without a display.
+// Uses EGL on the surfaceless platform where available (Mesa, including llvmpipe).
+// A pbuffer the size of the "window" stands in for the default framebuffer,
+// so that rendering, including the final blit, is the same as with a window
+class Headless_context {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLSurface surface = EGL_NO_SURFACE;
+  EGLContext context = EGL_NO_CONTEXT;
+
+  static EGLDisplay get_display() {
+    const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (client_extensions && std::strstr(client_extensions, "EGL_MESA_platform_surfaceless")) {
+      return eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+public:
+  Headless_context(Resolution res, const Config& cfg) {
+    display = get_display();
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+      FATAL("Failed to initialize EGL: error {:#x}", eglGetError());
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      FATAL("EGL {}.{} does not support desktop OpenGL: error {:#x}", major, minor, eglGetError());
+    }
+
+    const EGLint config_attribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_SAMPLES, static_cast<EGLint>(cfg.msaa_samples),
+      EGL_NONE,
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+      FATAL("No suitable EGL config for an offscreen OpenGL context");
+    }
+
+    const EGLint surface_attribs[] = {
+      EGL_WIDTH, static_cast<EGLint>(res.x),
+      EGL_HEIGHT, static_cast<EGLint>(res.y),
+      EGL_NONE,
+    };
+    surface = eglCreatePbufferSurface(display, config, surface_attribs);
+    if (surface == EGL_NO_SURFACE) {
+      FATAL("Failed to create {} EGL pbuffer: error {:#x}", res, eglGetError());
+    }
+
+    const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 6,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_CONTEXT_OPENGL_DEBUG, cfg.debug ? EGL_TRUE : EGL_FALSE,
+      EGL_NONE,
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+      FATAL("Failed to create headless GL 4.6 context: error {:#x}", eglGetError());
+    }
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+      FATAL("Failed to make headless GL context current: error {:#x}", eglGetError());
+    }
+  }
+
+  ~Headless_context() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglDestroySurface(display, surface);
+    eglTerminate(display);
+  }
+
+  Headless_context(const Headless_context&) = delete;
+  Headless_context& operator=(const Headless_context&) = delete;
+};
+
 struct Context {
+  // To tell the time to first frame, all of startup included
+  std::chrono::steady_clock::time_point init_start = std::chrono::steady_clock::now();
+  bool has_presented = false;
+
   Resolution resolution;
   SDL_init_lock sdl_init [[no_unique_address]];
   Unique_SDL_Window window;
   Unique_SDL_GLContext glcontext;
+  std::optional<Headless_context> headless_context;
 
   std::string_view renderer_name;
   std::string_view vendor_name;
   std::string_view driver_name;
 
+  unsigned refresh_rate = 0;  // of the window's display, 0 if unknown
+  bool has_vsync = false;
+
   explicit Context(const Config& cfg) : resolution(cfg.screen_res_x, cfg.screen_res_y), sdl_init(cfg) {
     constexpr Resolution min_res = {100, 100};
     if (resolution.x < min_res.x || resolution.y < min_res.y) {
       FATAL("Resolution {} is too small, minimum is {}", resolution, min_res);
     }
-    window.reset(SDL_CreateWindow(
-      nullptr,
-      SDL_WINDOWPOS_UNDEFINED,
-      SDL_WINDOWPOS_UNDEFINED,
-      resolution.x,
-      resolution.y,
-      SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
-    ));
-    if (!window) {
-      FATAL("Failed to create SDL window: {}", SDL_GetError());
-    }
 
-    glcontext.reset(SDL_GL_CreateContext(window.get()));
-    if (!glcontext) {
-      FATAL("Failed to create GL context: {}", SDL_GetError());
+    if (cfg.headless) {
+      headless_context.emplace(resolution, cfg);
+    } else {
+      window.reset(SDL_CreateWindow(
+        nullptr,
+        SDL_WINDOWPOS_UNDEFINED,
+        SDL_WINDOWPOS_UNDEFINED,
+        resolution.x,
+        resolution.y,
+        SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
+      ));
+      if (!window) {
+        FATAL("Failed to create SDL window: {}", SDL_GetError());
+      }
+
+      glcontext.reset(SDL_GL_CreateContext(window.get()));
+      if (!glcontext) {
+        FATAL("Failed to create GL context: {}", SDL_GetError());
+      }
     }
 
     glewExperimental = true;
-    if (glewInit() != GLEW_OK) {
-      FATAL("Failed to initialize GLEW");
+    GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // A GLX build of GLEW loads all entry points fine with an EGL context current,
+    // and only then fails to find a GLX display, which there is indeed none of
+    if (cfg.headless && glew_status == GLEW_ERROR_NO_GLX_DISPLAY) {
+      glew_status = GLEW_OK;
+    }
+#endif
+    if (glew_status != GLEW_OK) {
+      FATAL("Failed to initialize GLEW: error {}", glew_status);
+    }
+    gl::enable_parallel_shader_compile();
+    if (trace::is_enabled()) {
+      trace::calibrate_gpu_clock();
     }
 
-    SDL_GL_SetSwapInterval(1);
+    if (window) {
+      // Adaptive vsync, where available, tears a late frame rather than hold it for a refresh
+      has_vsync = SDL_GL_SetSwapInterval(-1) == 0 || SDL_GL_SetSwapInterval(1) == 0;
+      SDL_SetWindowTitle(window.get(), "Vector fields");
+      if (SDL_DisplayMode mode; SDL_GetWindowDisplayMode(window.get(), &mode) == 0) {
+        refresh_rate = mode.refresh_rate;
+      }
+    }
 
     if (cfg.msaa_samples) {
       glEnable(GL_MULTISAMPLE);
@@ -89,8 +298,6 @@ struct Context {
 
     glEnable(GL_BLEND);
 
-    SDL_SetWindowTitle(window.get(), "Vector fields");
-
     if (cfg.debug) {
       INFO("Enabling verbose OpenGL debugging");
       glEnable(GL_DEBUG_OUTPUT);
@@ -99,7 +306,34 @@ struct Context {
 
     Field_viz_config field_viz_cfg = {
       .particle_grid_size{cfg.particles_x, cfg.particles_y},
-      .particle_lifetime = cfg.particle_lifetime
+      .particle_lifetime = cfg.particle_lifetime,
+      .tick_rate = cfg.sim_rate,
+      .integrator = cfg.integrator,
+      .substeps = std::max(cfg.substeps, 1u),
+      .num_actors = cfg.num_actors,
+      .actors_ring_size = cfg.actors_ring_size,
+      .backend = cfg.backend,
+      .renderer = cfg.renderer,
+      .particle_format = cfg.particle_format,
+      .field_bake_size{cfg.field_bake_x, cfg.field_bake_y},
+      .field_bake_half = cfg.field_bake_half,
+      .validate = cfg.validate,
+      .gpu_timing = cfg.gpu_timing,
+      .capture_path = cfg.capture_path,
+      .capture_format =
+        cfg.capture_raw_rgb ? gl::Frame_capture::Format::rgb : gl::Frame_capture::Format::y4m,
+      .capture_size = resolution,
+      .capture_fps = cfg.capture_fps ? cfg.capture_fps : get_frame_rate(),
+      .snapshot_path = cfg.snapshot_path,
+      .restore_path = cfg.restore_path,
+      .autotune = cfg.autotune,
+      .autotune_cache_path = cfg.cache_dir.empty() ? std::string() : cfg.cache_dir + "/workgroup_sizes",
+      .driver_identity = {},
+      .hot_reload = cfg.hot_reload,
+      .frame_time_target_ms = !cfg.dynamic_resolution ? 0
+        : cfg.frame_time_target_ms ? cfg.frame_time_target_ms
+        : 1000.0f / get_frame_rate(),
+      .screen_size = resolution,
     };
     const unsigned spacing = cfg.particle_spacing ? cfg.particle_spacing : 2;
     for (int i: {0, 1}) {
@@ -108,20 +342,30 @@ struct Context {
       }
     }
 
-    fieldviz_init(field_viz_cfg);
-    fieldviz_ensure_least_framebuffer_size(resolution);
-
     renderer_name = gl::get_string(GL_RENDERER);
     vendor_name = gl::get_string(GL_VENDOR);
     driver_name = gl::get_string(GL_VERSION);
 
     INFO("Renderer is '{}' by '{}', driver/version '{}'", renderer_name, vendor_name, driver_name);
+
+    gl::enable_program_cache(
+      cfg.cache_dir,
+      fmt::format(FMT_STRING("{}\n{}\n{}"), renderer_name, vendor_name, driver_name)
+    );
+    field_viz_cfg.driver_identity =
+      fmt::format(FMT_STRING("{} / {} / {}"), renderer_name, vendor_name, driver_name);
+    fieldviz_init(field_viz_cfg);
+    gl::log_program_cache_summary();
   }
 
   ~Context() {
     fieldviz_deinit();
   }
 
+  unsigned get_frame_rate() const {
+    return refresh_rate ? refresh_rate : default_frame_rate;
+  }
+
   void update_resolution(Resolution res) {
     this->resolution = res;
     fieldviz_ensure_least_framebuffer_size(res);
@@ -139,23 +383,202 @@ struct Field_viz {
 
   unsigned current_tick = 0;
 
-  // Particles are stored in a buffer: 2x vec2 per particle, "head" and "tail". This buffer
-  // is used both to draw the particle and to calculate its new position in a compute pass.
+  // Particles are stored in buffers: 2x vec2 per particle, "head" and "tail". A buffer
+  // is used both to draw the particles and to calculate their new positions in a compute
+  // pass (or, with the CPU backend, it gets the new positions uploaded every tick).
   // Particle coordinates are such that neighbors in the grid are 1 unit apart
   // TODO: this means that if the grid is made smaller, individual units are larger on the
   // screen, greatly affecting the way the simulation looks
-  gl::Buffer particles_buffer;
+  //
+  // There are three generations of particles in rotation: a tick reads the latest one and
+  // writes the next, which then becomes the latest and gets drawn. So a tick never writes
+  // the buffer that a draw still in flight reads, and the driver may overlap the two
+  constexpr static int num_particle_generations = 3;
+  gl::Buffer particle_buffers[num_particle_generations];
+  int latest_generation = 0;
   gl::Vertex_array lines_vao;
 
+  const gl::Buffer& get_latest_particles() const {
+    return particle_buffers[latest_generation];
+  }
+
+  int get_next_generation() const {
+    return (latest_generation + 1) % num_particle_generations;
+  }
+
+  // Particles are stored in `particle_format`, see shader/particle_format.glsl.
+  // Unorm16 positions span the grid plus `unorm16_margin` of it on each side, and get
+  // clamped to that (particles that far out are off the screen anyway)
+  Particle_format particle_format = Particle_format::f32;
+  constexpr static float unorm16_margin = 0.5f;
+
+  size_t get_particle_stride() const {
+    return (particle_format == Particle_format::f32) ? sizeof(sim::Particle) : 2 * sizeof(uint32_t);
+  }
+
+  vec2 get_unorm16_origin() const {
+    return -unorm16_margin * vec2(grid_size);
+  }
+
+  vec2 get_unorm16_extent() const {
+    return (1 + 2 * unorm16_margin) * vec2(grid_size);
+  }
+
+  // Into the program in use, common to all programs that include particle_format.glsl
+  void upload_particle_format_uniforms() const {
+    constexpr GLint unif_loc_particle_format = 20;
+    constexpr GLint unif_loc_unorm_origin = 21;
+    constexpr GLint unif_loc_unorm_extent = 22;
+    const vec2 origin = get_unorm16_origin();
+    const vec2 extent = get_unorm16_extent();
+    glUniform1ui(unif_loc_particle_format, static_cast<GLuint>(particle_format));
+    glUniform2f(unif_loc_unorm_origin, origin.x, origin.y);
+    glUniform2f(unif_loc_unorm_extent, extent.x, extent.y);
+  }
+
+  // The same packing as the shaders do, for packed formats only
+  uint32_t pack_position(vec2 p) const {
+    if (particle_format == Particle_format::f16) {
+      return glm::packHalf2x16(p);
+    }
+    return glm::packUnorm2x16((p - get_unorm16_origin()) / get_unorm16_extent());
+  }
+
+  vec2 unpack_position(uint32_t word) const {
+    if (particle_format == Particle_format::f16) {
+      return glm::unpackHalf2x16(word);
+    }
+    return get_unorm16_origin() + glm::unpackUnorm2x16(word) * get_unorm16_extent();
+  }
+
+  // How far packing may move a position near `p`
+  float get_position_quantum(vec2 p) const {
+    switch (particle_format) {
+    case Particle_format::f32:
+      return 0;
+    case Particle_format::f16:
+      return std::ldexp(1.0f, std::ilogb(std::max(std::abs(p.x), std::abs(p.y))) - 10);
+    case Particle_format::unorm16: {
+      const vec2 extent = get_unorm16_extent();
+      return std::max(extent.x, extent.y) / 65535;
+    }
+    }
+    return 0;
+  }
+
+  std::vector<uint32_t> pack_particles(std::span<const sim::Particle> particles) const {
+    std::vector<uint32_t> words;
+    words.reserve(2 * particles.size());
+    for (const sim::Particle& p: particles) {
+      words.push_back(pack_position(p.front));
+      words.push_back(pack_position(p.back));
+    }
+    return words;
+  }
+
+  // Synchronous, so only for checks and the like
+  std::vector<sim::Particle> read_particles(const gl::Buffer& buffer) const {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<sim::Particle> particles(get_total_particles());
+    if (particle_format == Particle_format::f32) {
+      glGetNamedBufferSubData(buffer.get(), 0, sizeof(sim::Particle) * particles.size(), particles.data());
+      return particles;
+    }
+
+    std::vector<uint32_t> words(2 * particles.size());
+    glGetNamedBufferSubData(buffer.get(), 0, sizeof(uint32_t) * words.size(), words.data());
+    for (size_t i = 0; i < particles.size(); i++) {
+      particles[i] = {.front = unpack_position(words[2 * i]), .back = unpack_position(words[2 * i + 1])};
+    }
+    return particles;
+  }
+
   gl::Program draw_particles_program;
 
   // Compute shader
   gl::Program update_particles_program;
-  // Matches the size specified in the shader
-  constexpr static Resolution workgroup_size = {32, 32};
 
-  Resolution get_dispatch_size() const {
-    return grid_size / workgroup_size;
+  // Workgroup size of the shaders that run per particle, which get it as GROUP_SIZE.
+  // The fastest one depends on the GPU, see `autotune_workgroup_size`
+  unsigned workgroup_size = default_workgroup_size;
+  constexpr static unsigned default_workgroup_size = 1024;
+  constexpr static unsigned workgroup_size_candidates[] = {64, 128, 256, 512, 1024};
+
+  // particle.comp is specialized for the integrator, so that its loops are unrolled
+  gl::Defines get_particle_defines(unsigned group_size) const {
+    return {
+      {"GROUP_SIZE", group_size},
+      {"MAX_VELOCITY", sim::max_velocity},
+      {"INTEGRATOR", static_cast<unsigned>(scene.integrator)},
+      {"SUBSTEPS", scene.substeps},
+    };
+  }
+
+  // Workgroups go along X, and only spill over into Y past the least maximum count that
+  // GL_MAX_COMPUTE_WORK_GROUP_COUNT guarantees. The last workgroup may be partial
+  Resolution get_dispatch_size(unsigned group_size) const {
+    constexpr unsigned max_dispatch_x = 65535;
+    const unsigned num_groups = (get_total_particles() + group_size - 1) / group_size;
+    const unsigned x = std::min(num_groups, max_dispatch_x);
+    return {x, (num_groups + x - 1) / x};
+  }
+
+  // Time the particle program with each candidate workgroup size, return the fastest.
+  // Each candidate steps the latest generation into the next one (without making it
+  // the latest) until it has run `autotune_max_ticks`, or for `autotune_budget_ms`,
+  // whichever comes first. Batches are timed on the CPU, from submission until glFinish:
+  // GPU timer queries read 0 for compute on some drivers (llvmpipe). The batches of ticks
+  // grow, so that the waits for the GPU to drain are few
+  constexpr static unsigned autotune_max_ticks = 300;
+  constexpr static double autotune_budget_ms = 250;
+
+  unsigned autotune_workgroup_size() {
+    GLint max_invocations = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &max_invocations);
+
+    const unsigned slice_index = upload_actors();
+    if (is_field_baked()) {
+      bake_field();
+    }
+
+    const int scratch_generation = get_next_generation();
+    unsigned best_size = default_workgroup_size;
+    double best_ms = INFINITY;
+
+    for (unsigned group_size: workgroup_size_candidates) {
+      if (group_size > unsigned(max_invocations)) {
+        continue;
+      }
+      gl::Program program = gl::Program::from_compute("particle.comp", get_particle_defines(group_size));
+
+      // The first dispatch may include compiling the shader for real
+      dispatch_particles(program, group_size, scratch_generation);
+      glFinish();
+
+      unsigned num_ticks = 0;
+      double total_ms = 0;
+      for (unsigned batch = 1; num_ticks < autotune_max_ticks && total_ms < autotune_budget_ms; batch *= 2) {
+        batch = std::min(batch, autotune_max_ticks - num_ticks);
+        const auto begin = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < batch; i++) {
+          dispatch_particles(program, group_size, scratch_generation);
+        }
+        glFinish();
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        total_ms += elapsed.count();
+        num_ticks += batch;
+      }
+
+      const double ms_per_tick = total_ms / num_ticks;
+      INFO("Workgroup size {:>4}: {:.3f} ms per tick over {} ticks", group_size, ms_per_tick, num_ticks);
+      if (ms_per_tick < best_ms) {
+        best_ms = ms_per_tick;
+        best_size = group_size;
+      }
+    }
+
+    release_actors(slice_index);
+    return best_size;
   }
 
   // For a cooler effect, we paint on top of what was drawn on the previous frame.
@@ -166,50 +589,408 @@ struct Field_viz {
   gl::Framebuffer accum_fbo;
   gl::Renderbuffer accum_rbo;
 
+  // Dynamic resolution: particles are drawn into the bottom left `render_scale` of the screen
+  // size (in each dimension) in `accum_fbo`, which the final blit scales up to the screen.
+  // With a frame time target, the scale follows the GPU time of frames, as `gpu_timer`
+  // measures it (some frames late), averaged over frames since ticks do not come every frame,
+  // assuming that drawing passes take time in proportion to the pixels drawn and that the
+  // others take the same time regardless.
+  // On a change of scale (or of the screen size, with a frame time target), the accumulated
+  // image is resampled into `rescale_fbo` at the new size, and the two framebuffers trade
+  // places, so that what was drawn is kept
+  float render_scale = 1;
+  float next_render_scale = 1;  // applied when drawing next
+  float frame_time_target_ms = 0;  // 0 for a fixed scale
+  unsigned long last_rescale_frame = 0;
+  double full_scale_drawing_ms = 0, other_ms_average = 0;  // moving averages per frame
+  bool has_frame_time_sample = false;  // the averages start from the first sample, not from 0
+  unsigned long num_rescales = 0;
+  gl::Framebuffer rescale_fbo;
+  gl::Renderbuffer rescale_rbo;
+  Resolution screen_size = {0, 0};  // of the latest frame drawn
+  Resolution drawn_size = {0, 0};  // of the image in `accum_fbo`
+  // Readback wants the image at a size of its own, which `accum_fbo` only has without scaling
+  gl::Framebuffer readback_fbo;
+  gl::Renderbuffer readback_rbo;
+  Resolution readback_fbo_size = {0, 0};
+  constexpr static float min_render_scale = 0.25;
+  constexpr static float render_scale_tolerance = 0.05;  // relative, to not resample for little
+  constexpr static double frame_time_decay = 1.0 / 16;
+  // Until the frames drawn at the new scale get measured, and some more to average over
+  constexpr static unsigned frames_between_rescales = 2 * gl::Gpu_timer::frame_latency;
+
+  // With `Renderer::splat`, segments do not go through primitive setup, which is what
+  // limits drawing tens of millions of lines: a compute shader splats them into the
+  // layers of `splat_image` (per pixel sums of red, green, blue, and of the number of
+  // segments). Once a frame, the average color is blended over `accum_fbo`, the more opaque
+  // the more segments there were, and the image is cleared.
+  // The image is only allocated once the splat renderer is first used
+  Renderer renderer;
+  Resolution splat_image_size = {0, 0};
+  gl::Texture splat_image;
+  gl::Program splat_program;
+  gl::Program splat_resolve_program;
+  gl::Vertex_array empty_vao;
+  constexpr static int splat_image_layers = 4;
+
   unsigned particle_lifetime = 200;
 
-  // Things that act upon the field are represented in a uniform buffer,
-  // the format of which is one `GPU_actors` struct
-  // There are vortices (clockwise with force<0) and pushers (pullers when force<0)
-  struct GPU_actors {
-    static constexpr int max_vortices = 16;
-    static constexpr int max_pushers = 16;
+  // Things that act upon the field are in a shader storage buffer of `GPU_actor`s:
+  // all vortices (clockwise with force<0), then all pushers (pullers when force<0).
+  // The buffer is mapped persistently, and reallocated when the scene outgrows it.
+  //
+  // It is a ring of slices, one per tick: a tick writes its actors into the next slice,
+  // binds just that slice, and places a fence after its dispatches. Before the slice is
+  // written again a few ticks later, the CPU waits on the fence, in case the GPU is still
+  // reading it. How often that wait actually blocks is counted, to size the ring by
+  struct alignas(16) GPU_actor {
+    vec2 position;
+    float force;
+  };
 
-    struct alignas(16) Vortex {
-      vec2 position;
-      float force;
-    };
+  gl::Buffer actors_buffer;
+  std::byte* actors_buffer_mapped = nullptr;  // mapped write-only
+  size_t actors_buffer_capacity = 0;  // actors per slice
+  size_t actors_slice_stride = 0;  // in bytes
+  std::vector<gl::Sync> actors_slice_fences;  // one per slice, null if it was never used
+  unsigned actors_ring_index = 0;
+  unsigned long num_actors_fence_waits = 0;
+
+  void ensure_actors_buffer_capacity(size_t num_actors) {
+    if (num_actors <= actors_buffer_capacity) {
+      return;
+    }
+    if (actors_buffer_mapped) {
+      gl::unmap_buffer(actors_buffer);
+    }
 
-    struct alignas(16) Pusher {
-      vec2 position;
-      float force;
-    };
+    GLint offset_alignment = 1;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+
+    constexpr size_t min_capacity = 64;
+    actors_buffer_capacity = std::max({num_actors, 2 * actors_buffer_capacity, min_capacity});
+    actors_slice_stride = sizeof(GPU_actor) * actors_buffer_capacity;
+    actors_slice_stride = (actors_slice_stride + offset_alignment - 1) / offset_alignment * offset_alignment;
+    const size_t size = actors_slice_stride * actors_slice_fences.size();
 
-    Vortex vortices[max_vortices];
-    Pusher pushers[max_pushers];
+    // The old buffer's storage lives on until the GPU is done with it, and so no slice
+    // of the new one can be in use yet
+    actors_buffer = gl::Buffer::create();
+    glNamedBufferStorage(actors_buffer.get(), size, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+    actors_buffer_mapped = gl::map_buffer_range_as<std::byte>(
+      actors_buffer,
+      0,
+      size,
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+    );
+    for (gl::Sync& fence: actors_slice_fences) {
+      fence.reset();
+    }
+  }
+
+  // Wait until the GPU is done reading the slice from its previous use
+  void wait_for_actors_slice(unsigned index) {
+    gl::Sync& fence = actors_slice_fences[index];
+    if (!fence) {
+      return;
+    }
+
+    GLenum status = glClientWaitSync(fence.get(), 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      num_actors_fence_waits++;
+      constexpr GLuint64 timeout_ns = 5'000'000'000;
+      status = glClientWaitSync(fence.get(), GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+    }
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+      WARNING("Waiting for the GPU to release actors slice {} failed, overwriting anyway", index);
+    }
+    fence.reset();
+  }
+
+  sim::Scene scene;
+
+  sim::Step_params get_step_params() const {
+    return scene.get_step_params(current_tick, particle_lifetime);
+  }
+
+  // With a CPU backend, the simulation runs in `cpu_particles` and gets uploaded
+  // (the vectorized one keeps its own state, and only writes `cpu_particles` for upload)
+  std::optional<sim::Cpu_simulation> cpu_simulation;
+  std::optional<sim::Simd_simulation> simd_simulation;
+  std::vector<sim::Particle> cpu_particles;
+
+  // Optionally, the field is baked into a (coarser) texture once per tick, and particles
+  // sample that instead of evaluating all actors, which changes the cost per tick from
+  // O(particles * actors) to O(texels * actors + particles)
+  Resolution field_bake_size = {0, 0};
+  GLenum field_bake_format = GL_RG32F;
+  gl::Texture baked_field;
+  gl::Program bake_field_program;
+  constexpr static Resolution bake_workgroup_size = {8, 8};  // GROUP_SIZE_X/Y in field_bake.comp
+
+  bool is_field_baked() const {
+    return field_bake_size.x > 0 && field_bake_size.y > 0;
+  }
+
+  // With validation on, the CPU backend instead serves as a reference for the shader
+  std::optional<sim::Cpu_simulation> reference_simulation;
+  constexpr static unsigned validation_interval_ticks = 600;
+
+  // Optional GPU timing of the passes, see `gl::Gpu_timer`. Also on while tracing, to put
+  // the passes in the trace, and with dynamic resolution, but only logged with `gpu_timing`
+  enum Gpu_pass {
+    gpu_pass_bake,
+    gpu_pass_simulate,
+    gpu_pass_lines,
+    gpu_pass_splat,
+    gpu_pass_resolve,
+    gpu_pass_blit,
   };
+  constexpr static std::string_view gpu_pass_names[] = {
+    "bake", "simulate", "lines", "splat", "resolve", "blit",
+  };
+  std::optional<gl::Gpu_timer> gpu_timer;
+  bool should_log_gpu_timing = false;
+  unsigned long num_frames = 0;
 
-  gl::Buffer actors_buffer;
-  GPU_actors* actors_buffer_mapped;  // mapped write-only
-  unsigned num_vortices = 0;
-  unsigned num_pushers = 0;
+  // Optional recording of the accumulated image every frame, see `gl::Frame_capture`
+  std::optional<gl::Frame_capture> capture;
+  Resolution capture_size = {0, 0};
+
+  std::string snapshot_path;
+  snapshot::Async_writer snapshot_writer;
+
+  // With `hot_reload`, programs are rebuilt in place when their files change, so that
+  // shaders can be worked on without restarting and losing the state of the simulation
+  std::optional<gl::Program_reloader> program_reloader;
+
+  // Programs are all submitted before any is waited for, so that the driver may build them
+  // in parallel, while buffers and such are set up. See `finish_programs`
+  std::vector<std::pair<gl::Program*, gl::Pending_program>> pending_programs;
+
+  void build_compute_program(gl::Program& program, std::string_view path, gl::Defines defines = {}) {
+    pending_programs.emplace_back(&program, gl::Pending_program::from_compute(path, defines));
+    if (program_reloader) {
+      program_reloader->watch_compute(program, path, std::move(defines));
+    }
+  }
+
+  void build_frag_vert_program(gl::Program& program, std::string_view frag_path, std::string_view vert_path) {
+    pending_programs.emplace_back(&program, gl::Pending_program::from_frag_vert(frag_path, vert_path));
+    if (program_reloader) {
+      program_reloader->watch_frag_vert(program, frag_path, vert_path);
+    }
+  }
+
+  void finish_programs() {
+    for (auto& [program, pending]: pending_programs) {
+      *program = std::move(pending).finish();
+    }
+    pending_programs.clear();
+  }
+
+  void save_snapshot() {
+    if (snapshot_path.empty()) {
+      WARNING("Not saving a snapshot: no file to save to was given");
+      return;
+    }
+    if (particle_format != Particle_format::f32) {
+      WARNING("Not saving a snapshot: only particles stored as f32 can be saved");
+      return;
+    }
+    snapshot_writer.start(
+      snapshot_path,
+      get_latest_particles(),
+      {
+        .grid_size = grid_size,
+        .tick = current_tick,
+        .particle_lifetime = particle_lifetime,
+        .tick_rate = static_cast<uint32_t>(scene.tick_rate),
+        .num_actors = scene.num_actors,
+        .particles = {},
+        .vortices = scene.vortices,
+        .pushers = scene.pushers,
+      }
+    );
+  }
+
+  void gpu_timer_begin(Gpu_pass pass) {
+    if (gpu_timer) {
+      gpu_timer->begin(pass);
+    }
+  }
+
+  void gpu_timer_end(Gpu_pass pass) {
+    if (gpu_timer) {
+      gpu_timer->end(pass);
+    }
+  }
 
   explicit Field_viz(const Field_viz_config& cfg) :
     grid_size{cfg.particle_grid_size},
-    particle_lifetime{cfg.particle_lifetime} {
-    // Round the grid size down to workgroup size. TODO handle this more gracefully?
-    grid_size /= workgroup_size;
-    grid_size *= workgroup_size;
+    particle_lifetime{
+      std::max(1u, cfg.particle_lifetime * cfg.tick_rate / unsigned(sim::reference_tick_rate))
+    } {
+    frame_time_target_ms = cfg.frame_time_target_ms;
+    if (cfg.gpu_timing || trace::is_enabled() || frame_time_target_ms > 0) {
+      gpu_timer.emplace(gpu_pass_names);
+      should_log_gpu_timing = cfg.gpu_timing;
+    }
+    if (!cfg.capture_path.empty()) {
+      capture.emplace(cfg.capture_path, cfg.capture_format, cfg.capture_size, cfg.capture_fps);
+      capture_size = cfg.capture_size;
+    }
+
+    // A restored run continues with the particles, tick, and actors of the snapshot,
+    // but at the configured rate and lifetime (which only matter from then on)
+    snapshot_path = cfg.snapshot_path;
+    std::optional<snapshot::Mapped_snapshot> restored;
+    if (!cfg.restore_path.empty()) {
+      const snapshot::State& state = restored.emplace(cfg.restore_path).get();
+      grid_size = state.grid_size;
+      current_tick = state.tick;
+      INFO(
+        "Restoring tick {} of a {}x{} run from '{}'", state.tick, grid_size.x, grid_size.y, cfg.restore_path
+      );
+      if (state.tick_rate != cfg.tick_rate || state.particle_lifetime != particle_lifetime) {
+        WARNING(
+          "Snapshot was taken at {} ticks/s with lifetime {}, continuing at {} with {}",
+          state.tick_rate,
+          state.particle_lifetime,
+          cfg.tick_rate,
+          particle_lifetime
+        );
+      }
+    }
 
     if (unsigned num_particles = get_total_particles()) {
       INFO("Simulating {}x{} = {} particles", grid_size.x, grid_size.y, num_particles);
     } else {
-      FATAL("The number of particles got rounded down to zero. Try larger grid");
+      FATAL("There are no particles in a {}x{} grid. Try larger grid", grid_size.x, grid_size.y);
+    }
+
+    switch (cfg.backend) {
+    case Sim_backend::gl:
+      if (cfg.validate) {
+        reference_simulation.emplace(grid_size);
+      }
+      if (cfg.field_bake_size.x > 0 && cfg.field_bake_size.y > 0) {
+        field_bake_size = cfg.field_bake_size;
+        field_bake_format = cfg.field_bake_half ? GL_RG16F : GL_RG32F;
+        INFO(
+          "Baking the field into {}x{} {} once per tick",
+          field_bake_size.x,
+          field_bake_size.y,
+          cfg.field_bake_half ? "RG16F" : "RG32F"
+        );
+      }
+      break;
+    case Sim_backend::cpu:
+      cpu_simulation.emplace(grid_size);
+      INFO("Simulating on the CPU with {} threads", cpu_simulation->get_num_threads());
+      break;
+    case Sim_backend::cpu_simd:
+      simd_simulation.emplace(grid_size);
+      INFO(
+        "Simulating on the CPU with {} threads, using {}",
+        simd_simulation->get_num_threads(),
+        sim::get_isa_name(simd_simulation->get_isa())
+      );
+      break;
+    }
+    if (cfg.backend != Sim_backend::gl && cfg.field_bake_size.x > 0) {
+      WARNING("Baking the field is only implemented for the OpenGL backend, ignoring");
+    }
+
+    particle_format = cfg.particle_format;
+    if (cfg.backend != Sim_backend::gl && particle_format != Particle_format::f32) {
+      WARNING("Packing particles is only implemented for the OpenGL backend, storing them as f32");
+      particle_format = Particle_format::f32;
+    }
+    if (particle_format != Particle_format::f32) {
+      INFO(
+        "Storing particles as {}, {} bytes each",
+        (particle_format == Particle_format::f16) ? "f16" : "unorm16",
+        get_particle_stride()
+      );
     }
 
-    {  // VBO
-      particles_buffer = gl::Buffer::create();
-      glNamedBufferStorage(particles_buffer.get(), 2 * sizeof(vec2) * get_total_particles(), nullptr, 0);
+    // Programs first, so that they build while everything else is set up.
+    // The particle programs depend on the workgroup size, so if it has yet to be tuned,
+    // they are only submitted once it has been
+    scene.integrator = cfg.integrator;
+    scene.substeps = cfg.substeps;
+    if (cfg.hot_reload) {
+      program_reloader.emplace();
+    }
+    bool should_autotune = false;
+    if (cfg.autotune && cfg.backend == Sim_backend::gl) {
+      std::optional<unsigned> tuned = load_tuned_workgroup_size(cfg.autotune_cache_path, cfg.driver_identity);
+      if (tuned) {
+        INFO("Using the workgroup size of {} tuned earlier for this renderer", *tuned);
+        workgroup_size = *tuned;
+      } else {
+        should_autotune = true;
+      }
+    }
+    const auto build_particle_programs = [&] {
+      build_compute_program(update_particles_program, "particle.comp", get_particle_defines(workgroup_size));
+      build_compute_program(splat_program, "splat.comp", {{"GROUP_SIZE", workgroup_size}});
+    };
+    if (!should_autotune) {
+      build_particle_programs();
+    }
+    build_frag_vert_program(draw_particles_program, "lines.frag", "lines.vert");
+    build_frag_vert_program(splat_resolve_program, "splat_resolve.frag", "fullscreen.vert");
+    if (is_field_baked()) {
+      build_compute_program(
+        bake_field_program,
+        "field_bake.comp",
+        {
+          {"GROUP_SIZE_X", bake_workgroup_size.x},
+          {"GROUP_SIZE_Y", bake_workgroup_size.y},
+          {"MAX_VELOCITY", sim::max_velocity},
+        }
+      );
+    }
+
+    {  // VBOs
+      GLbitfield flags = 0;
+      if (cpu_simulation || simd_simulation) {
+        cpu_particles.resize(get_total_particles());
+        flags |= GL_DYNAMIC_STORAGE_BIT;
+      }
+      // A restored snapshot goes straight from the mapped file into the latest generation,
+      // unless it needs packing first
+      const void* restored_particles = restored ? restored->get().particles.data() : nullptr;
+      std::vector<uint32_t> restored_packed;
+      if (restored && particle_format != Particle_format::f32) {
+        restored_packed = pack_particles(restored->get().particles);
+        restored_particles = restored_packed.data();
+      }
+      for (int i = 0; i < num_particle_generations; i++) {
+        particle_buffers[i] = gl::Buffer::create();
+        glNamedBufferStorage(
+          particle_buffers[i].get(),
+          get_particle_stride() * get_total_particles(),
+          (i == latest_generation) ? restored_particles : nullptr,
+          flags
+        );
+        // Particles that have not spawned yet sit at zero (as on the CPU backends), which in unorm16
+        // is not all zero bits. Storage without data is undefined, so every generation is cleared
+        if (!(restored && i == latest_generation)) {
+          const uint32_t zero = (particle_format == Particle_format::f32) ? 0 : pack_position(vec2(0));
+          glClearNamedBufferData(particle_buffers[i].get(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        }
+      }
+      if (restored) {
+        std::span<const sim::Particle> particles = restored->get().particles;
+        if (cpu_simulation) {
+          cpu_particles.assign(particles.begin(), particles.end());
+        } else if (simd_simulation) {
+          simd_simulation->set_particles(particles);
+        }
+      }
     }
 
     {  // VAO & vertex format
@@ -218,91 +999,292 @@ struct Field_viz {
 
       glEnableVertexAttribArray(0);
       glVertexAttribBinding(0, 0);
-      glVertexAttribFormat(0, 2, GL_FLOAT, false, 0);
-
-      glBindVertexBuffer(0, particles_buffer.get(), 0, sizeof(vec2));
+      switch (particle_format) {
+      case Particle_format::f32:
+        glVertexAttribFormat(0, 2, GL_FLOAT, false, 0);
+        break;
+      case Particle_format::f16:
+        glVertexAttribFormat(0, 2, GL_HALF_FLOAT, false, 0);
+        break;
+      case Particle_format::unorm16:
+        glVertexAttribFormat(0, 2, GL_UNSIGNED_SHORT, true, 0);
+        break;
+      }
     }
 
-    {  // SSBOs and UBOs
-      actors_buffer = gl::Buffer::create();
-      glNamedBufferStorage(
-        actors_buffer.get(),
-        sizeof(GPU_actors),
-        nullptr,
-        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
-      );
-      actors_buffer_mapped = gl::map_buffer_range_as<GPU_actors>(
-        actors_buffer,
-        0,
-        sizeof(GPU_actors),
-        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
-      );
+    {  // SSBOs
+      scene.num_actors = restored ? restored->get().num_actors : cfg.num_actors;
+      scene.tick_rate = cfg.tick_rate;
+      scene.update(0, grid_size);
+      actors_slice_fences.resize(std::max(1u, cfg.actors_ring_size));
+      ensure_actors_buffer_capacity(scene.vortices.size() + scene.pushers.size());
+    }
 
-      gl::bind_ubo(gl::UBO_binding_point::fieldviz_actors, actors_buffer);
-      gl::bind_ssbo(gl::SSBO_binding_point::fieldviz_particles, particles_buffer);
+    if (is_field_baked()) {
+      baked_field = gl::Texture::create(GL_TEXTURE_2D);
+      glTextureStorage2D(baked_field.get(), 1, field_bake_format, field_bake_size.x, field_bake_size.y);
+      glTextureParameteri(baked_field.get(), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTextureParameteri(baked_field.get(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTextureParameteri(baked_field.get(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTextureParameteri(baked_field.get(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
 
-    draw_particles_program = gl::Program::from_frag_vert("lines.frag", "lines.vert");
-    update_particles_program = gl::Program::from_compute("particle.comp");
+    // Both renderers are always ready, so that switching between them is instant
+    renderer = cfg.renderer;
+    empty_vao = gl::Vertex_array::create();
+    ensure_least_framebuffer_size(cfg.screen_size);
+
+    if (should_autotune) {
+      finish_programs();  // autotuning runs ticks, which may bake the field
+      workgroup_size = autotune_workgroup_size();
+      INFO("Workgroup size {} is the fastest", workgroup_size);
+      store_tuned_workgroup_size(cfg.autotune_cache_path, cfg.driver_identity, workgroup_size);
+      build_particle_programs();
+    }
+    finish_programs();
 
     gl::poll_errors_and_die("field viz init");
   }
 
   ~Field_viz() {
-    gl::unmap_buffer(actors_buffer);
+    if (!snapshot_path.empty()) {
+      save_snapshot();
+    }
+    snapshot_writer.finish();
+
+    if (actors_buffer_mapped) {
+      gl::unmap_buffer(actors_buffer);
+    }
   }
 
   void advance_simulation() {
-    {  // Update mapped buffer data
-      auto& m = *actors_buffer_mapped;
-      float w = grid_size.x;
-      float h = grid_size.y;
-      float sec = current_tick / 60.0f;
+    scene.update(current_tick, grid_size);
+    if (cpu_simulation || simd_simulation) {
+      advance_simulation_cpu();
+    } else if (reference_simulation && (current_tick + 1) % validation_interval_ticks == 0) {
+      validate_simulation_gl();
+    } else {
+      advance_simulation_gl();
+      if (is_field_baked() && current_tick == 0) {
+        report_baked_field_error();
+      }
+    }
+    current_tick++;
+  }
 
-      num_vortices = 0;
-      num_pushers = 0;
-      const auto add_vortex = [&](float x, float y, float f) {
-        m.vortices[num_vortices++] = {.position = {w * x, h * y}, .force = f};
-      };
-      const auto add_pusher = [&](float x, float y, float f) {
-        m.pushers[num_pushers++] = {.position = {w * x, h * y}, .force = f};
-      };
+  void advance_simulation_cpu() {
+    if (simd_simulation) {
+      simd_simulation->step(get_step_params(), cpu_particles);
+    } else {
+      cpu_simulation->step(cpu_particles, get_step_params());
+    }
 
-      add_vortex(0.5, 0.5, 200);
-      add_vortex(0.2, 0.1, 70 * sin(sec * 0.5));
-      add_vortex(0.3, 0.3, 70 * cos(sec * 0.5));
-      add_pusher(0.3, 0.9, 200 * sin(sec));
-      add_pusher(0.7, 0.5, 75 + 75 * sin(sec * 1.5f));
+    const int next_generation = get_next_generation();
+    gpu_timer_begin(gpu_pass_simulate);
+    glNamedBufferSubData(
+      particle_buffers[next_generation].get(),
+      0,
+      sizeof(sim::Particle) * cpu_particles.size(),
+      cpu_particles.data()
+    );
+    gpu_timer_end(gpu_pass_simulate);
+    latest_generation = next_generation;
+  }
+
+  // Write the actors of this tick into the next slice of the ring and bind it
+  unsigned upload_actors() {
+    const unsigned num_vortices = scene.vortices.size();
+    const unsigned num_pushers = scene.pushers.size();
+    ensure_actors_buffer_capacity(num_vortices + num_pushers);
+
+    const unsigned slice_index = actors_ring_index;
+    const size_t slice_offset = actors_slice_stride * slice_index;
+    const size_t slice_size = sizeof(GPU_actor) * (num_vortices + num_pushers);
+    wait_for_actors_slice(slice_index);
+
+    {  // Update mapped buffer data
+      GPU_actor* m = start_lifetime_as<GPU_actor>(actors_buffer_mapped + slice_offset);
+      for (const sim::Actor& actor: scene.vortices) {
+        *m++ = {.position = actor.position, .force = actor.force};
+      }
+      for (const sim::Actor& actor: scene.pushers) {
+        *m++ = {.position = actor.position, .force = actor.force};
+      }
     }
+    gl::flush_mapped_buffer_range(actors_buffer, slice_offset, slice_size);
+
+    // A range cannot be empty, but without actors the shaders will not read any
+    glBindBufferRange(
+      GL_SHADER_STORAGE_BUFFER,
+      static_cast<GLuint>(gl::SSBO_binding_point::fieldviz_actors),
+      actors_buffer.get(),
+      slice_offset,
+      std::max(slice_size, sizeof(GPU_actor))
+    );
+    return slice_index;
+  }
+
+  // Once the GPU is done with this tick, the CPU may write its slice again
+  void release_actors(unsigned slice_index) {
+    actors_slice_fences[slice_index] = gl::Sync::fence();
+    actors_ring_index = (slice_index + 1) % actors_slice_fences.size();
+  }
 
-    glUseProgram(update_particles_program.get());
+  // Uniform locations of the field, common to all programs that include field.glsl
+  constexpr static GLint unif_loc_num_vortices = 10;
+  constexpr static GLint unif_loc_num_pushers = 11;
+
+  void bake_field() {
+    glUseProgram(bake_field_program.get());
+
+    constexpr GLint unif_loc_texel_size = 0;
+    glUniform1ui(unif_loc_num_vortices, scene.vortices.size());
+    glUniform1ui(unif_loc_num_pushers, scene.pushers.size());
+    glUniform2f(
+      unif_loc_texel_size,
+      float(grid_size.x) / field_bake_size.x,
+      float(grid_size.y) / field_bake_size.y
+    );
+
+    glBindImageTexture(0, baked_field.get(), 0, false, 0, GL_WRITE_ONLY, field_bake_format);
+    Resolution bake_dispatch_size =
+      (field_bake_size + bake_workgroup_size - Resolution(1)) / bake_workgroup_size;
+    gpu_timer_begin(gpu_pass_bake);
+    glDispatchCompute(bake_dispatch_size.x, bake_dispatch_size.y, 1);
+    gpu_timer_end(gpu_pass_bake);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glBindTextureUnit(0, baked_field.get());
+  }
+
+  // Step the latest generation of particles into `out_generation`, with a particle program
+  // built for `group_size` (not necessarily the current one, see `autotune_workgroup_size`)
+  void dispatch_particles(const gl::Program& program, unsigned group_size, int out_generation) {
+    glUseProgram(program.get());
 
     {  // Upload uniform data
       constexpr GLint unif_loc_tick = 0;
       constexpr GLint unif_loc_particle_lifetime = 1;
-      constexpr GLint unif_loc_num_vortices = 10;
-      constexpr GLint unif_loc_num_pushers = 11;
+      constexpr GLint unif_loc_time_step = 2;
+      constexpr GLint unif_loc_grid_size = 3;
+      constexpr GLint unif_loc_use_baked_field = 12;
+      constexpr GLint unif_loc_inv_grid_size = 13;
       glUniform1ui(unif_loc_tick, current_tick);
       glUniform1ui(unif_loc_particle_lifetime, particle_lifetime);
-      glUniform1ui(unif_loc_num_vortices, num_vortices);
-      glUniform1ui(unif_loc_num_pushers, num_pushers);
+      glUniform1f(unif_loc_time_step, get_step_params().time_step);
+      glUniform2ui(unif_loc_grid_size, grid_size.x, grid_size.y);
+      glUniform1ui(unif_loc_num_vortices, scene.vortices.size());
+      glUniform1ui(unif_loc_num_pushers, scene.pushers.size());
+      glUniform1i(unif_loc_use_baked_field, is_field_baked());
+      glUniform2f(unif_loc_inv_grid_size, 1.0f / grid_size.x, 1.0f / grid_size.y);
+      upload_particle_format_uniforms();
     }
 
-    gl::flush_mapped_buffer_range(
-      actors_buffer,
-      offsetof(GPU_actors, vortices),
-      sizeof(GPU_actors::Vortex) * num_vortices
+    gl::bind_ssbo(gl::SSBO_binding_point::fieldviz_particles_in, get_latest_particles());
+    gl::bind_ssbo(gl::SSBO_binding_point::fieldviz_particles_out, particle_buffers[out_generation]);
+
+    Resolution dispatch_size = get_dispatch_size(group_size);
+    gpu_timer_begin(gpu_pass_simulate);
+    glDispatchCompute(dispatch_size.x, dispatch_size.y, 1);
+    gpu_timer_end(gpu_pass_simulate);
+  }
+
+  void advance_simulation_gl() {
+    const unsigned slice_index = upload_actors();
+    if (is_field_baked()) {
+      bake_field();
+    }
+
+    const int next_generation = get_next_generation();
+    dispatch_particles(update_particles_program, workgroup_size, next_generation);
+
+    // The new generation is read as vertices by the draw, and as storage by the next tick
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    latest_generation = next_generation;
+    release_actors(slice_index);
+  }
+
+  // Compare the latest baked field to the analytic one, see `sim::measure_baked_field_error`.
+  // This synchronizes with the GPU, so only do it once in a while
+  void report_baked_field_error() const {
+    std::vector<vec2> texels(field_bake_size.x * field_bake_size.y);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glGetTextureImage(
+      baked_field.get(),
+      0,
+      GL_RG,
+      GL_FLOAT,
+      sizeof(vec2) * texels.size(),
+      texels.data()
     );
-    gl::flush_mapped_buffer_range(
-      actors_buffer,
-      offsetof(GPU_actors, pushers),
-      sizeof(GPU_actors::Pusher) * num_pushers
+
+    sim::Field_error error =
+      sim::measure_baked_field_error(texels, field_bake_size, grid_size, get_step_params());
+    INFO(
+      "Tick {}: baked field error vs analytic (grid units/tick, max velocity {}): "
+      "mean {:.4f}, p99 {:.4f}, max {:.4f} over {} samples",
+      current_tick,
+      sim::max_velocity,
+      error.mean,
+      error.p99,
+      error.max,
+      error.num_samples
     );
+  }
 
-    Resolution dispatch_size = get_dispatch_size();
-    glDispatchCompute(dispatch_size.x, dispatch_size.y, 1);
+  // Run one tick of the shader, and check that the result matches the CPU reference
+  // stepped from the same state. This synchronizes with the GPU, so only do it once in a while
+  void validate_simulation_gl() {
+    if (is_field_baked()) {
+      // The reference is analytic, so rather compare the field itself
+      advance_simulation_gl();
+      report_baked_field_error();
+      return;
+    }
 
-    current_tick++;
+    std::vector<sim::Particle> expected = read_particles(get_latest_particles());
+    reference_simulation->step(expected, get_step_params());
+
+    advance_simulation_gl();
+    std::vector<sim::Particle> actual = read_particles(get_latest_particles());
+
+    // Packed positions are also off by up to a quantum, and unorm16 ones get clamped
+    constexpr float tolerance = 1e-3;
+    const bool is_clamped = (particle_format == Particle_format::unorm16);
+    const vec2 clamp_min = get_unorm16_origin();
+    const vec2 clamp_max = clamp_min + get_unorm16_extent();
+    float max_error = 0;
+    unsigned num_mismatched = 0;
+    for (size_t i = 0; i < actual.size(); i++) {
+      // A particle sitting exactly on an actor has no defined velocity, and both agree on that
+      // (but there is no NaN in unorm16)
+      if (std::isnan(expected[i].front.x) && (std::isnan(actual[i].front.x) || is_clamped)) {
+        continue;
+      }
+      if (is_clamped) {
+        expected[i].front = glm::clamp(expected[i].front, clamp_min, clamp_max);
+      }
+      float error = std::max(
+        glm::distance(expected[i].front, actual[i].front),
+        glm::distance(expected[i].back, actual[i].back)
+      );
+      if (!(error <= tolerance + get_position_quantum(expected[i].front))) {
+        num_mismatched++;
+      }
+      max_error = std::max(max_error, error);
+    }
+
+    if (num_mismatched > 0) {
+      WARNING(
+        "Tick {}: {} of {} particles differ from the CPU reference (max error {})",
+        current_tick,
+        num_mismatched,
+        actual.size(),
+        max_error
+      );
+    } else {
+      INFO("Tick {}: simulation matches the CPU reference (max error {})", current_tick, max_error);
+    }
   }
 
   void ensure_least_framebuffer_size(Resolution required_size) {
@@ -330,60 +1312,345 @@ struct Field_viz {
       }
     }
 
-    accum_fbo = gl::Framebuffer::create();
-    glBindFramebuffer(GL_FRAMEBUFFER, accum_fbo.get());
+    // What was drawn is kept, so that it can be resampled to a new screen size
+    gl::Framebuffer old_fbo = std::move(accum_fbo);
+    gl::Renderbuffer old_rbo = std::move(accum_rbo);
+    create_color_framebuffer(accum_fbo, accum_rbo, accum_fbo_size);
+    if (old_fbo && drawn_size.x > 0 && drawn_size.y > 0) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, old_fbo.get());
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, accum_fbo.get());
+      glBlitFramebuffer(
+        0, 0, drawn_size.x, drawn_size.y, 0, 0, drawn_size.x, drawn_size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST
+      );
+    }
+    if (rescale_fbo) {
+      create_color_framebuffer(rescale_fbo, rescale_rbo, accum_fbo_size);
+    }
+  }
+
+  static void create_color_framebuffer(gl::Framebuffer& fbo, gl::Renderbuffer& rbo, Resolution size) {
+    fbo = gl::Framebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
 
-    accum_rbo = gl::Renderbuffer::create();
-    glBindRenderbuffer(GL_RENDERBUFFER, accum_rbo.get());
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB8, accum_fbo_size.x, accum_fbo_size.y);
+    rbo = gl::Renderbuffer::create();
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo.get());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB8, size.x, size.y);
 
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, accum_rbo.get());
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo.get());
 
     if (GLenum s = glCheckFramebufferStatus(GL_FRAMEBUFFER); s != GL_FRAMEBUFFER_COMPLETE) {
-      FATAL("Framebuffer {0} is incomplete: status {1} ({1:x})", accum_fbo.get(), s);
+      FATAL("Framebuffer {0} is incomplete: status {1} ({1:x})", fbo.get(), s);
     }
   }
 
-  void draw(Resolution res, bool should_clear) const {
+  Resolution get_render_size(Resolution res, float scale) const {
+    return glm::max(Resolution(glm::round(vec2(res) * scale)), Resolution(1));
+  }
+
+  // Bind `accum_fbo` to draw into at the current scale, which may change here. Returns the size drawn
+  Resolution begin_drawing(Resolution res) {
+    if (res != screen_size) {
+      // Frames measured so far were drawn at the old screen size: carry the estimate over
+      // in proportion to the pixels, and skip the measurements still to come of those frames
+      if (screen_size.x > 0 && screen_size.y > 0) {
+        full_scale_drawing_ms *= double(res.x) * res.y / (double(screen_size.x) * screen_size.y);
+        last_rescale_frame = num_frames;
+      }
+      screen_size = res;
+    }
+
+    // `drawn_size` is from before the screen size changed, if it did
+    const Resolution size = get_render_size(res, next_render_scale);
+    const bool is_rescaled = (next_render_scale != render_scale);
+    const bool is_resized = (frame_time_target_ms > 0 && size != drawn_size);
+    if ((is_rescaled || is_resized) && drawn_size.x > 0 && drawn_size.y > 0) {
+      if (!rescale_fbo) {
+        create_color_framebuffer(rescale_fbo, rescale_rbo, accum_fbo_size);
+      }
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, accum_fbo.get());
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, rescale_fbo.get());
+      glBlitFramebuffer(
+        0, 0, drawn_size.x, drawn_size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR
+      );
+      std::swap(accum_fbo, rescale_fbo);
+      std::swap(accum_rbo, rescale_rbo);
+    }
+    if (is_rescaled) {
+      render_scale = next_render_scale;
+      num_rescales++;
+    }
+    drawn_size = size;
+
     glBindFramebuffer(GL_FRAMEBUFFER, accum_fbo.get());
-    glViewport(0, 0, res.x, res.y);
+    glViewport(0, 0, size.x, size.y);
+    return size;
+  }
+
+  // Pick the scale to draw the next frames at, from averages of the frames measured
+  void update_render_scale() {
+    // The latest frame measured is `frame_latency - 1` frames old, which may be before the last change
+    if (num_frames >= last_rescale_frame + gl::Gpu_timer::frame_latency) {
+      double drawing_ms = 0, other_ms = 0;
+      for (int pass = 0; pass < int(std::size(gpu_pass_names)); pass++) {
+        const double ms = gpu_timer->get_latest_ms(pass);
+        if (std::isnan(ms)) {
+          return;
+        }
+        const bool is_drawing =
+          (pass == gpu_pass_lines || pass == gpu_pass_splat || pass == gpu_pass_resolve);
+        (is_drawing ? drawing_ms : other_ms) += ms;
+      }
+      const double full_scale_ms = drawing_ms / (render_scale * render_scale);
+      if (has_frame_time_sample) {
+        full_scale_drawing_ms += (full_scale_ms - full_scale_drawing_ms) * frame_time_decay;
+        other_ms_average += (other_ms - other_ms_average) * frame_time_decay;
+      } else {
+        full_scale_drawing_ms = full_scale_ms;
+        other_ms_average = other_ms;
+        has_frame_time_sample = true;
+      }
+    }
+    if (num_frames < last_rescale_frame + frames_between_rescales || full_scale_drawing_ms <= 0) {
+      return;
+    }
+
+    const double drawing_target_ms = frame_time_target_ms - other_ms_average;
+    const float scale = (drawing_target_ms <= 0)
+      ? min_render_scale
+      : glm::clamp(float(std::sqrt(drawing_target_ms / full_scale_drawing_ms)), min_render_scale, 1.0f);
+    if (std::abs(scale - render_scale) > render_scale_tolerance * render_scale
+        || (scale != render_scale && (scale == 1 || scale == min_render_scale))) {
+      next_render_scale = scale;
+      last_rescale_frame = num_frames;
+    }
+  }
+
+  void ensure_splat_image_size() {
+    if (splat_image_size == accum_fbo_size) {
+      return;
+    }
+    splat_image_size = accum_fbo_size;
+    splat_image = gl::Texture::create(GL_TEXTURE_2D_ARRAY);
+    glTextureStorage3D(
+      splat_image.get(),
+      1,
+      GL_R32UI,
+      splat_image_size.x,
+      splat_image_size.y,
+      splat_image_layers
+    );
+    glTextureParameteri(splat_image.get(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(splat_image.get(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glClearTexImage(splat_image.get(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  }
+
+  void toggle_renderer() {
+    renderer = (renderer == Renderer::lines) ? Renderer::splat : Renderer::lines;
+    INFO("Drawing particles as {}", (renderer == Renderer::lines) ? "lines" : "splats");
+  }
+
+  // Each tick only draws its own segment of the particles' paths, so when several ticks
+  // run per frame, all but the last one are painted into `accum_fbo` with this
+  // (or only splatted, to be resolved along with the last one)
+  void paint(Resolution res) {
+    draw_particles(begin_drawing(res));
+  }
+
+  void draw(Resolution res, bool should_clear) {
+    const Resolution size = begin_drawing(res);
 
     if (should_clear) {
       glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT);
     }
 
+    draw_particles(size);
+    if (renderer == Renderer::splat) {
+      resolve_splats();
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, accum_fbo.get());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    gpu_timer_begin(gpu_pass_blit);
+    const GLenum filter = (size == res) ? GL_NEAREST : GL_LINEAR;
+    glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, res.x, res.y, GL_COLOR_BUFFER_BIT, filter);
+    gpu_timer_end(gpu_pass_blit);
+
+    if (capture) {
+      capture->capture(get_image_framebuffer(capture_size));
+    }
+  }
+
+  // A framebuffer with the accumulated image at `size` in its bottom left: `accum_fbo` when
+  // it was drawn at that size, otherwise `readback_fbo` with the image scaled to it
+  GLuint get_image_framebuffer(Resolution size) {
+    if (drawn_size == size || drawn_size.x == 0 || drawn_size.y == 0) {
+      return accum_fbo.get();
+    }
+    if (readback_fbo_size != size) {
+      readback_fbo_size = size;
+      create_color_framebuffer(readback_fbo, readback_rbo, readback_fbo_size);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, accum_fbo.get());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, readback_fbo.get());
+    glBlitFramebuffer(0, 0, drawn_size.x, drawn_size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    return readback_fbo.get();
+  }
+
+  std::vector<unsigned char> read_image(Resolution res) {
+    std::vector<unsigned char> pixels(3 * size_t{res.x} * res.y);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, get_image_framebuffer(res));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, res.x, res.y, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+  }
+
+  // If viewport is too wide, cut off left & right; if too tall, cut off top & bottom
+  vec2 get_view_scale(Resolution res) const {
+    float aspect = (float) grid_size.x * res.y / (grid_size.y * res.x);
+    return {std::max(1.0f, aspect), std::max(1.0f, 1.0f / aspect)};
+  }
+
+  void draw_particles(Resolution res) {
+    if (renderer == Renderer::splat) {
+      draw_splats(res);
+    } else {
+      draw_lines(res);
+    }
+  }
+
+  void draw_lines(Resolution res) {
     glUseProgram(draw_particles_program.get());
 
     {  // Upload uniforms
-      constexpr GLint unif_loc_workgroup_size = 0;
-      constexpr GLint unif_loc_workgroup_num = 2;
+      constexpr GLint unif_loc_grid_size = 0;
       constexpr GLint unif_loc_scale = 4;
 
-      Resolution dispatch_size = get_dispatch_size();
-      glUniform2ui(unif_loc_workgroup_size, workgroup_size.x, workgroup_size.y);
-      glUniform2ui(unif_loc_workgroup_num, dispatch_size.x, dispatch_size.y);
+      glUniform2ui(unif_loc_grid_size, grid_size.x, grid_size.y);
 
-      // If viewport is too wide, cut off left & right; if too tall, cut off top & bottom
-      float aspect = (float) grid_size.x * res.y / (grid_size.y * res.x);
-      glUniform2f(unif_loc_scale, std::max(1.0f, aspect), std::max(1.0f, 1.0f / aspect));
+      vec2 scale = get_view_scale(res);
+      glUniform2f(unif_loc_scale, scale.x, scale.y);
+      upload_particle_format_uniforms();
     }
 
+    // Each particle is two vertices, front and back
     glBindVertexArray(lines_vao.get());
+    glBindVertexBuffer(0, get_latest_particles().get(), 0, get_particle_stride() / 2);
+    gpu_timer_begin(gpu_pass_lines);
     glDrawArrays(GL_LINES, 0, 2 * get_total_particles());
+    gpu_timer_end(gpu_pass_lines);
+  }
 
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, accum_fbo.get());
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-    glBlitFramebuffer(0, 0, res.x, res.y, 0, 0, res.x, res.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  void draw_splats(Resolution res) {
+    ensure_splat_image_size();
+    glUseProgram(splat_program.get());
+
+    {  // Upload uniforms
+      constexpr GLint unif_loc_scale = 0;
+      constexpr GLint unif_loc_resolution = 1;
+      constexpr GLint unif_loc_grid_size = 2;
+
+      vec2 scale = get_view_scale(res);
+      glUniform2f(unif_loc_scale, scale.x, scale.y);
+      glUniform2ui(unif_loc_resolution, res.x, res.y);
+      glUniform2ui(unif_loc_grid_size, grid_size.x, grid_size.y);
+      upload_particle_format_uniforms();
+    }
+
+    gl::bind_ssbo(gl::SSBO_binding_point::fieldviz_particles_in, get_latest_particles());
+    glBindImageTexture(1, splat_image.get(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+
+    Resolution dispatch_size = get_dispatch_size(workgroup_size);
+    gpu_timer_begin(gpu_pass_splat);
+    glDispatchCompute(dispatch_size.x, dispatch_size.y, 1);
+    gpu_timer_end(gpu_pass_splat);
+  }
+
+  // Blend the splats of this frame over the framebuffer bound, and clear them
+  void resolve_splats() {
+    // Both the draw reading the splats and the clear after it must see every atomic add
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glUseProgram(splat_resolve_program.get());
+    glBindTextureUnit(1, splat_image.get());
+    glBindVertexArray(empty_vao.get());
+
+    gpu_timer_begin(gpu_pass_resolve);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBlendFunc(GL_ONE, GL_ZERO);
+    glClearTexImage(splat_image.get(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    gpu_timer_end(gpu_pass_resolve);
+  }
+
+  void end_frame() {
+    num_frames++;
+    snapshot_writer.poll();
+    if (program_reloader) {
+      program_reloader->poll();
+    }
+    if (gpu_timer) {
+      gpu_timer->end_frame();
+      if (frame_time_target_ms > 0) {
+        update_render_scale();
+      }
+      if (should_log_gpu_timing && num_frames % gl::Gpu_timer::stats_window == 0) {
+        gpu_timer->log_summary();
+      }
+    }
+  }
+
+  void report_stats() const {
+    if (should_log_gpu_timing) {
+      gpu_timer->log_summary();
+    }
+    if (frame_time_target_ms > 0) {
+      INFO(
+        "Drawing at {:.0f}% scale for a {:.1f} ms frame time target, after {} changes of scale",
+        100 * render_scale,
+        frame_time_target_ms,
+        num_rescales
+      );
+    }
+    if (!cpu_simulation && !simd_simulation) {
+      INFO(
+        "Waited for the GPU to release an actors slice {} times in {} ticks, with {} slices",
+        num_actors_fence_waits,
+        current_tick,
+        actors_slice_fences.size()
+      );
+    }
   }
 };
 
 // ================================= Shallow public API =================================
 
+std::string_view get_backend_name(Sim_backend backend) {
+  switch (backend) {
+  case Sim_backend::gl:
+    return "gl";
+  case Sim_backend::cpu:
+    return "cpu";
+  case Sim_backend::cpu_simd:
+    return "cpu-simd";
+  }
+  return "?";
+}
+
+void parse_backend(std::string_view arg, Sim_backend& x) {
+  for (Sim_backend backend: {Sim_backend::gl, Sim_backend::cpu, Sim_backend::cpu_simd}) {
+    if (arg == get_backend_name(backend)) {
+      x = backend;
+      return;
+    }
+  }
+  throw arg::Arg_parse_exception{.subject = arg, .defect = "is not a backend (gl, cpu, cpu-simd)"};
+}
+
 static Deferred_init_unchecked<Context> global_render_context;
 static Deferred_init_unchecked<Field_viz> global_fieldviz;
 
 Init_lock::Init_lock(const Config& cfg) {
+  TRACE_SCOPE("init");
   global_render_context.init(cfg);
 }
 
@@ -398,15 +1665,76 @@ void handle_sdl_event(const SDL_Event& event) {
 }
 
 void present_frame() {
+  TRACE_SCOPE("present_frame");
+  global_fieldviz->end_frame();
   gl::poll_errors_and_warn("latest frame");
-  SDL_GL_SwapWindow(global_render_context->window.get());
+  if (global_render_context->window) {
+    TRACE_SCOPE("swap");
+    SDL_GL_SwapWindow(global_render_context->window.get());
+  } else {
+    // Nothing to swap with a pbuffer, but the frame's commands should start executing
+    TRACE_SCOPE("flush");
+    glFlush();
+  }
+
+  if (!global_render_context->has_presented) {
+    // Once, so that the time includes the GPU (and driver) getting through the frame
+    glFinish();
+    global_render_context->has_presented = true;
+    const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - global_render_context->init_start;
+    INFO("First frame presented {:.1f} ms after starting initialization", elapsed.count());
+  }
+}
+
+void wait_idle() {
+  glFinish();
+}
+
+unsigned get_frame_rate() {
+  return global_render_context->get_frame_rate();
+}
+
+bool is_vsync_enabled() {
+  return global_render_context->has_vsync;
+}
+
+void report_stats() {
+  global_fieldviz->report_stats();
+}
+
+void fieldviz_paint() {
+  TRACE_SCOPE("fieldviz_paint");
+  global_fieldviz->paint(global_render_context->resolution);
 }
 
 void fieldviz_draw(bool should_clear) {
+  TRACE_SCOPE("fieldviz_draw");
   global_fieldviz->draw(global_render_context->resolution, should_clear);
 }
 
+void fieldviz_save_snapshot() {
+  global_fieldviz->save_snapshot();
+}
+
+void fieldviz_toggle_renderer() {
+  global_fieldviz->toggle_renderer();
+}
+
+unsigned fieldviz_get_total_particles() {
+  return global_fieldviz->get_total_particles();
+}
+
+std::vector<sim::Particle> fieldviz_read_particles() {
+  return global_fieldviz->read_particles(global_fieldviz->get_latest_particles());
+}
+
+std::vector<unsigned char> fieldviz_read_image() {
+  return global_fieldviz->read_image(global_render_context->resolution);
+}
+
 void fieldviz_update() {
+  TRACE_SCOPE("fieldviz_update");
   global_fieldviz->advance_simulation();
 }
 
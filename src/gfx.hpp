@@ -1,16 +1,66 @@
 #pragma once
 
 #include "gl.hpp"
+#include "sim.hpp"
 #include "util/singleton.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace gfx {
+enum class Sim_backend {
+  gl,  // compute shader
+  cpu,  // native, multithreaded
+  cpu_simd,  // native, multithreaded and vectorized
+};
+
+// Names of the backends as options take them ("gl", "cpu", "cpu-simd")
+std::string_view get_backend_name(Sim_backend);
+// Throws `arg::Arg_parse_exception` if `arg` is not a backend's name
+void parse_backend(std::string_view arg, Sim_backend&);
+
+enum class Renderer {
+  lines,  // draw each particle's latest segment as a line
+  splat,  // accumulate segments into an image in a compute shader, for very many particles
+};
+
+// How the compute shader stores particles between ticks
+enum class Particle_format {
+  f32,  // two vec2, 16 bytes
+  f16,  // two vec2 of halves, 8 bytes, coarse far from the origin of large grids
+  unorm16,  // two vec2 of 16-bit fixed point over the grid (and then some), 8 bytes
+};
+
 struct Config {
   unsigned screen_res_x = 1560, screen_res_y = 960;
   bool debug = false;
+  bool headless = false;  // offscreen EGL context instead of a window
+  bool gpu_timing = false;  // time GPU passes with timer queries and log the results
   unsigned msaa_samples = 0;  // 0 for no MSAA
   unsigned particles_x = 0, particles_y = 0;  // 0 for auto
-  unsigned particle_lifetime = 200;
+  unsigned particle_lifetime = 200;  // in ticks at 60 Hz, scaled to `sim_rate`
+  unsigned sim_rate = 60;  // simulation ticks per second of scene time
+  sim::Integrator integrator = sim::Integrator::euler;
+  unsigned substeps = 1;  // integrator steps per tick, all in the same pass over the particles
   unsigned particle_spacing = 2;
+  unsigned num_actors = 0;  // 0 for the demo scene, see `sim::Scene::num_actors`
+  unsigned actors_ring_size = 3;  // ticks whose actor uploads may be in flight at once
+  Sim_backend backend = Sim_backend::gl;
+  Renderer renderer = Renderer::lines;
+  Particle_format particle_format = Particle_format::f32;  // only packed with the OpenGL backend
+  unsigned field_bake_x = 0, field_bake_y = 0;  // 0 to evaluate the field per particle
+  bool field_bake_half = false;  // RG16F instead of RG32F
+  std::string capture_path;  // record frames there (a file, a FIFO, or "-" for stdout)
+  bool capture_raw_rgb = false;  // instead of Y4M
+  unsigned capture_fps = 0;  // only goes into the Y4M header, 0 for `get_frame_rate()`
+  std::string snapshot_path;  // written on exit, and when asked to
+  std::string restore_path;  // snapshot to continue from
+  std::string cache_dir;  // for compiled programs and such, empty for no caching
+  bool autotune = false;  // find the fastest workgroup size, unless found for this renderer before
+  bool validate = false;  // periodically check the compute shader against the CPU backend
+  bool hot_reload = false;  // rebuild programs when their shader files change
+  bool dynamic_resolution = false;  // draw at a lower resolution when frames take too long on the GPU
+  float frame_time_target_ms = 0;  // for dynamic resolution, 0 for a refresh period
 };
 
 struct Init_lock: Singleton_lock<Init_lock> {
@@ -23,7 +73,19 @@ void deinit();
 
 void handle_sdl_event(const SDL_Event&);
 void present_frame();
+void wait_idle();
+
+constexpr unsigned default_frame_rate = 60;
+unsigned get_frame_rate();  // the display's refresh rate, or `default_frame_rate` if unknown or headless
+bool is_vsync_enabled();  // whether presenting a frame waits for a refresh
+void report_stats();
 
 void fieldviz_update();
+void fieldviz_paint();  // draw the latest tick into the accumulated image, without presenting
 void fieldviz_draw(bool should_clear);
+void fieldviz_save_snapshot();
+void fieldviz_toggle_renderer();
+unsigned fieldviz_get_total_particles();
+std::vector<sim::Particle> fieldviz_read_particles();  // of the latest tick, waits for the GPU
+std::vector<unsigned char> fieldviz_read_image();  // accumulated RGB, bottom row first, waits for the GPU
 }  // namespace gfx
@@ -68,6 +68,23 @@ using Vertex_array = detail::GL_basic_object<&glCreateVertexArrays, &glDeleteVer
 using Query = detail::GL_basic_object<&glCreateQueries, &glDeleteQueries>;
 using Texture = detail::GL_basic_object<&glCreateTextures, &glDeleteTextures>;
 
+namespace detail {
+struct Sync_deleter {
+  void operator()(GLsync sync) const noexcept {
+    glDeleteSync(sync);
+  }
+};
+}  // namespace detail
+
+// A fence in the command stream, signaled once the GPU is done with all commands before it
+struct Sync: Unique_handle<GLsync, detail::Sync_deleter, nullptr> {
+  using Unique_handle::Unique_handle;
+
+  static Sync fence() {
+    return Sync(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  }
+};
+
 // ================================= Mapping buffers =================================
 
 template<typename T>
@@ -101,12 +118,13 @@ inline void unmap_buffer(const Buffer& buffer) {
 
 enum class UBO_binding_point : GLenum {
   // All uniform buffer binding points known in the program
-  fieldviz_actors = 0,
 };
 
 enum class SSBO_binding_point : GLenum {
   // All shader storage buffer binding points known in the program
-  fieldviz_particles = 0,
+  fieldviz_particles_in = 0,
+  fieldviz_actors = 1,
+  fieldviz_particles_out = 2,
 };
 
 inline void bind_ubo(UBO_binding_point slot, const Buffer& buffer) {
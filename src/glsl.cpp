@@ -1,9 +1,17 @@
 #include "glsl.hpp"
 #include "util/util.hpp"
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <memory>
 #include <optional>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <vector>
 
 namespace gl {
 // ============================= Shader sources from files =============================
@@ -14,11 +22,16 @@ namespace gl {
 // - you cannot prevent recursive inclusion (in general, there is a limited depth)
 
 class File_source {
+public:
   constexpr static const char source_dir[] = "shader/";
+
+private:
   constexpr static bool line_directive_has_filename = true;
 
   std::string src;
   std::string original_path;
+  std::vector<std::string> dependencies;  // the file itself, and all it includes
+  std::string* error;  // null if errors are fatal
 
   static std::optional<std::string_view> try_get_include_filename(std::string_view line) {
     using std::find, std::find_if, std::find_if_not;
@@ -69,18 +82,45 @@ class File_source {
     }
   }
 
+  void fail(std::string message) {
+    if (!error) {
+      FATAL("{}", message);
+    }
+    if (error->empty()) {
+      *error = std::move(message);
+    }
+  }
+
   void append_from_file(std::string_view path, int recurse) {
+    if (error && !error->empty()) {
+      return;
+    }
     if (constexpr int limit = 20; recurse > limit) {
-      FATAL("Shader '{}{}' has a recursive #include chain of depth > {}", source_dir, original_path, limit);
+      fail(fmt::format(
+        FMT_STRING("Shader '{}{}' has a recursive #include chain of depth > {}"),
+        source_dir,
+        original_path,
+        limit
+      ));
+      return;
     }
 
+    if (std::find(dependencies.begin(), dependencies.end(), path) == dependencies.end()) {
+      dependencies.emplace_back(path);
+    }
     std::ifstream stream(std::string{source_dir} + std::string{path});
     if (!stream.good()) {
       if (recurse == 0) {
-        FATAL("Shader '{}{}': cannot open file", source_dir, path);
+        fail(fmt::format(FMT_STRING("Shader '{}{}': cannot open file"), source_dir, path));
       } else {
-        FATAL("Shader '{0}{1}' (included from '{0}{2}'): cannot open file", source_dir, path, original_path);
+        fail(fmt::format(
+          FMT_STRING("Shader '{0}{1}' (included from '{0}{2}'): cannot open file"),
+          source_dir,
+          path,
+          original_path
+        ));
       }
+      return;
     }
 
     append_line_directive(0, path);
@@ -100,10 +140,17 @@ class File_source {
   }
 
 public:
-  explicit File_source(std::string_view path) : original_path{path} {
+  // Failing to read a file is fatal, unless `error_` is given, which then gets the first error
+  explicit File_source(std::string_view path, std::string* error_ = nullptr) :
+    original_path{path},
+    error{error_} {
     append_from_file(path, 0);
   }
 
+  [[nodiscard]] const std::vector<std::string>& get_dependencies() const {
+    return dependencies;
+  }
+
   operator std::string() && {
     return std::move(src);
   }
@@ -116,33 +163,68 @@ constexpr static const char shader_prologue[] =
   "#extension GL_ARB_explicit_uniform_location: require\n"
   "#extension GL_ARB_shading_language_include: require\n";
 
-// `src` is std::string because we need zero-termination for glShaderSource,
-// so would have made a std::string anyway
-static Shader compile_shader(Shader::Type type, const std::string& src, std::string_view name) {
+Define::Define(std::string_view name_, float value_) :
+  name{name_},
+  value{fmt::format(FMT_STRING("{:#}"), value_)} {}
+
+static std::string get_define_block(const Defines& defines) {
+  std::string result;
+  for (const Define& define: defines) {
+    fmt::format_to(std::back_inserter(result), FMT_STRING("#define {} {}\n"), define.name, define.value);
+  }
+  return result;
+}
+
+// `src` and `define_block` are std::string because we need zero-termination
+// for glShaderSource, so would have made a std::string anyway.
+// With GL_KHR_parallel_shader_compile, compiling goes on in the background after this
+static Shader start_compiling_shader(
+  Shader::Type type,
+  const std::string& src,
+  std::string_view name,
+  const std::string& define_block
+) {
   GLuint id = glCreateShader(static_cast<GLenum>(type));
   if (id == 0) {
     FATAL("Shader {}: failed to create shader object", name);
   }
 
-  const char* lines[] = {shader_prologue, src.c_str()};
+  const char* lines[] = {shader_prologue, define_block.c_str(), src.c_str()};
   glShaderSource(id, std::size(lines), lines, nullptr);
   glCompileShader(id);
+  return Shader(id);
+}
 
+// The info log if compiling failed (which waits for compiling to complete)
+static std::optional<std::string> get_compile_error(const Shader& shader) {
   int compile_success = 0;
-  glGetShaderiv(id, GL_COMPILE_STATUS, &compile_success);
-  if (!compile_success) {
-    int log_length = 0;
-    glGetShaderiv(id, GL_INFO_LOG_LENGTH, &log_length);
-    auto log = std::make_unique_for_overwrite<char[]>(log_length + 1);
-    glGetShaderInfoLog(id, log_length, &log_length, log.get());
-    FATAL("Shader {} failed to compile. Log:\n{}", name, log.get());
+  glGetShaderiv(shader.get(), GL_COMPILE_STATUS, &compile_success);
+  if (compile_success) {
+    return {};
   }
+  int log_length = 0;
+  glGetShaderiv(shader.get(), GL_INFO_LOG_LENGTH, &log_length);
+  auto log = std::make_unique_for_overwrite<char[]>(log_length + 1);
+  log[0] = '\0';
+  glGetShaderInfoLog(shader.get(), log_length + 1, &log_length, log.get());
+  return std::string{log.get()};
+}
 
-  return Shader(id);
+static Shader compile_shader(
+  Shader::Type type,
+  const std::string& src,
+  std::string_view name,
+  const std::string& define_block = {}
+) {
+  Shader shader = start_compiling_shader(type, src, name, define_block);
+  if (std::optional<std::string> log = get_compile_error(shader)) {
+    FATAL("Shader {} failed to compile. Log:\n{}", name, *log);
+  }
+  return shader;
 }
 
-Shader Shader::from_file(Type type, std::string_view file_path) {
-  return compile_shader(type, File_source{file_path}, file_path);
+Shader Shader::from_file(Type type, std::string_view file_path, const Defines& defines) {
+  return compile_shader(type, File_source{file_path}, file_path, get_define_block(defines));
 }
 
 Shader Shader::from_source(Type type, std::string_view source) {
@@ -151,7 +233,8 @@ Shader Shader::from_source(Type type, std::string_view source) {
 
 // ================================== Shader programs ==================================
 
-static GLuint link_program_low(std::span<const Shader> shaders) {
+// Like compiling, linking may go on in the background after this
+static GLuint start_linking_program(std::span<const Shader> shaders, bool retrievable) {
   if (shaders.empty()) {
     FATAL("Tried to link a program without any shaders");
   }
@@ -161,6 +244,9 @@ static GLuint link_program_low(std::span<const Shader> shaders) {
     FATAL("Failed to create shader program");
   }
 
+  if (retrievable) {
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, true);
+  }
   for (const Shader& s: shaders) {
     glAttachShader(id, s.get());
   }
@@ -168,33 +254,341 @@ static GLuint link_program_low(std::span<const Shader> shaders) {
   for (const Shader& s: shaders) {
     glDetachShader(id, s.get());
   }
+  return id;
+}
 
+// The info log if linking failed (which waits for linking to complete)
+static std::optional<std::string> get_link_error(GLuint id) {
   int link_success = 0;
   glGetProgramiv(id, GL_LINK_STATUS, &link_success);
-  if (!link_success) {
-    int log_length = 0;
-    glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_length);
-    auto log = std::make_unique_for_overwrite<char[]>(log_length + 1);
-    glGetProgramInfoLog(id, log_length, &log_length, log.get());
-    FATAL("Program with id {} failed to link. Log:\n{}", id, log.get());
+  if (link_success) {
+    return {};
   }
+  int log_length = 0;
+  glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_length);
+  auto log = std::make_unique_for_overwrite<char[]>(log_length + 1);
+  log[0] = '\0';
+  glGetProgramInfoLog(id, log_length + 1, &log_length, log.get());
+  return std::string{log.get()};
+}
 
+static GLuint link_program_low(std::span<const Shader> shaders, bool retrievable = false) {
+  GLuint id = start_linking_program(shaders, retrievable);
+  if (std::optional<std::string> log = get_link_error(id)) {
+    FATAL("Program with id {} failed to link. Log:\n{}", id, *log);
+  }
   return id;
 }
 
 Program::Program(std::span<const Shader> shaders) : Unique_handle(link_program_low(shaders)) {}
 
-Program Program::from_frag_vert(std::string_view frag_path, std::string_view vert_path) {
-  Shader shaders[] = {
-    Shader::from_file(Shader::Type::fragment, frag_path),
-    Shader::from_file(Shader::Type::vertex, vert_path),
+// =============================== Program binary cache ================================
+
+struct Program_source {
+  Shader::Type type;
+  std::string_view path;
+  std::string text;
+  std::string define_block;
+};
+
+struct Program_cache {
+  std::filesystem::path directory;
+  std::string driver_identity;
+  std::vector<GLint> binary_formats;
+
+  unsigned num_hits = 0;
+  unsigned num_misses = 0;
+  unsigned num_rejected = 0;
+  double seconds_saved = 0;
+};
+
+static std::optional<Program_cache> program_cache;
+
+// Precedes the binary in a cache file
+struct Program_cache_header {
+  constexpr static char expected_magic[8] = {'f', 's', 'p', 'r', 'o', 'g', 'b', 'n'};
+  constexpr static uint32_t expected_version = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t binary_format;
+  uint64_t binary_size;
+  double compile_seconds;  // what compiling and linking took, to tell what a hit saves
+};
+
+// Far above what drivers produce for these programs, only to reject nonsense sizes
+constexpr static uint64_t max_program_binary_size = 64 << 20;
+
+// FNV-1a, which is plenty for telling apart a handful of programs
+static uint64_t hash_bytes(std::string_view bytes, uint64_t hash = 0xcbf29ce484222325) {
+  for (char c: bytes) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+  }
+  return hash;
+}
+
+static std::filesystem::path get_cache_path(
+  const Program_cache& cache,
+  std::span<const Program_source> sources
+) {
+  uint64_t hash = hash_bytes(cache.driver_identity);
+  hash = hash_bytes(shader_prologue, hash);
+  for (const Program_source& source: sources) {
+    const GLenum type = static_cast<GLenum>(source.type);
+    hash = hash_bytes({reinterpret_cast<const char*>(&type), sizeof(type)}, hash);
+    hash = hash_bytes(source.define_block, hash);
+    hash = hash_bytes(source.text, hash);
+  }
+  return cache.directory / fmt::format(FMT_STRING("{:016x}.bin"), hash);
+}
+
+// Returns 0 if there is no usable binary for the program
+static GLuint try_load_program_binary(const std::filesystem::path& path, double& compile_seconds) {
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream.good()) {
+    return 0;
+  }
+
+  Program_cache_header header;
+  if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header))
+      || std::memcmp(header.magic, header.expected_magic, sizeof(header.magic)) != 0
+      || header.version != header.expected_version) {
+    return 0;
+  }
+  // The binary is the rest of the file. Checked before allocating, so that a corrupt
+  // or truncated file is a miss rather than an allocation of whatever size it claims
+  std::error_code error;
+  const uintmax_t file_size = std::filesystem::file_size(path, error);
+  if (error || header.binary_size == 0 || header.binary_size > max_program_binary_size
+      || header.binary_size != file_size - sizeof(header)) {
+    return 0;
+  }
+  std::vector<char> binary(header.binary_size);
+  if (!stream.read(binary.data(), binary.size())) {
+    return 0;
+  }
+
+  // glProgramBinary reports an unknown format as a GL error rather than a failed link
+  const auto& formats = program_cache->binary_formats;
+  if (std::find(formats.begin(), formats.end(), GLint(header.binary_format)) == formats.end()) {
+    return 0;
+  }
+
+  GLuint id = glCreateProgram();
+  glProgramBinary(id, header.binary_format, binary.data(), binary.size());
+  int link_success = 0;
+  glGetProgramiv(id, GL_LINK_STATUS, &link_success);
+  if (!link_success) {
+    glDeleteProgram(id);
+    return 0;
+  }
+
+  compile_seconds = header.compile_seconds;
+  return id;
+}
+
+static void store_program_binary(GLuint id, const std::filesystem::path& path, double compile_seconds) {
+  int length = 0;
+  glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  Program_cache_header header;
+  std::memcpy(header.magic, header.expected_magic, sizeof(header.magic));
+  header.version = header.expected_version;
+  header.compile_seconds = compile_seconds;
+
+  std::vector<char> binary(length);
+  GLsizei real_length = 0;
+  GLenum format = 0;
+  glGetProgramBinary(id, length, &real_length, &format, binary.data());
+  header.binary_format = format;
+  header.binary_size = real_length;
+
+  // Write to a temporary and rename, so that a concurrent instance never reads half a file
+  std::filesystem::path temp_path = path;
+  temp_path += ".tmp";
+  {
+    std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(binary.data(), real_length);
+    if (!stream.good()) {
+      WARNING("Cannot write program binary to '{}'", temp_path.string());
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    WARNING("Cannot write program binary to '{}': {}", path.string(), error.message());
+  }
+}
+
+static bool is_compile_parallel = false;
+
+void enable_parallel_shader_compile() {
+  if (GLEW_KHR_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);  // as many as the driver likes
+    is_compile_parallel = true;
+  }
+}
+
+static double get_seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Pending_program Pending_program::start_build(std::span<const Program_source> sources) {
+  Pending_program pending;
+  pending.start = std::chrono::steady_clock::now();
+
+  if (program_cache) {
+    const std::filesystem::path path = get_cache_path(*program_cache, sources);
+    const bool exists = std::filesystem::exists(path);
+    double compile_seconds = 0;
+    if (GLuint id = exists ? try_load_program_binary(path, compile_seconds) : 0) {
+      program_cache->num_hits++;
+      program_cache->seconds_saved += compile_seconds - get_seconds_since(pending.start);
+      pending.program = Program(id);
+      return pending;
+    }
+
+    if (exists) {
+      program_cache->num_rejected++;
+      INFO("Cached binary of program '{}' is unusable, recompiling", sources[0].path);
+    }
+    program_cache->num_misses++;
+    pending.cache_path = path.string();
+  }
+
+  for (const Program_source& source: sources) {
+    pending.shaders.push_back(
+      start_compiling_shader(source.type, source.text, source.path, source.define_block)
+    );
+    pending.shader_names.emplace_back(source.path);
+  }
+  pending.program = Program(start_linking_program(pending.shaders, program_cache.has_value()));
+  return pending;
+}
+
+bool Pending_program::is_ready() const {
+  if (shaders.empty() || !is_compile_parallel) {
+    return true;
+  }
+  GLint is_complete = false;
+  glGetProgramiv(program.get(), GL_COMPLETION_STATUS_KHR, &is_complete);
+  return is_complete;
+}
+
+Program Pending_program::finish() && {
+  if (shaders.empty()) {
+    return std::move(program);
+  }
+
+  for (size_t i = 0; i < shaders.size(); i++) {
+    if (std::optional<std::string> log = get_compile_error(shaders[i])) {
+      FATAL("Shader {} failed to compile. Log:\n{}", shader_names[i], *log);
+    }
+  }
+  if (std::optional<std::string> log = get_link_error(program.get())) {
+    FATAL("Program with id {} failed to link. Log:\n{}", program.get(), *log);
+  }
+
+  // What the cache saves is rather overestimated when other work overlapped building
+  if (!cache_path.empty()) {
+    store_program_binary(program.get(), cache_path, get_seconds_since(start));
+  }
+  return std::move(program);
+}
+
+void enable_program_cache(std::string_view directory, std::string_view driver_identity) {
+  if (directory.empty()) {
+    return;
+  }
+
+  int num_formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  if (num_formats <= 0) {
+    INFO("Driver supports no program binary formats, not caching programs");
+    return;
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    WARNING("Cannot create program cache directory '{}': {}", directory, error.message());
+    return;
+  }
+
+  Program_cache& cache = program_cache.emplace();
+  cache.directory = directory;
+  cache.driver_identity = driver_identity;
+  cache.binary_formats.resize(num_formats);
+  glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, cache.binary_formats.data());
+}
+
+void log_program_cache_summary() {
+  if (!program_cache) {
+    return;
+  }
+  const Program_cache& cache = *program_cache;
+  INFO(
+    "Program cache '{}': {} hits, {} misses ({} unusable), saved {:.1f} ms of compiling",
+    cache.directory.string(),
+    cache.num_hits,
+    cache.num_misses,
+    cache.num_rejected,
+    cache.seconds_saved * 1e3
+  );
+}
+
+// ================================= Loading programs ==================================
+
+Program Program::from_frag_vert(
+  std::string_view frag_path,
+  std::string_view vert_path,
+  const Defines& defines
+) {
+  return Pending_program::from_frag_vert(frag_path, vert_path, defines).finish();
+}
+
+Program Program::from_compute(std::string_view compute_path, const Defines& defines) {
+  return Pending_program::from_compute(compute_path, defines).finish();
+}
+
+Pending_program Pending_program::from_frag_vert(
+  std::string_view frag_path,
+  std::string_view vert_path,
+  const Defines& defines
+) {
+  const std::string define_block = get_define_block(defines);
+  const Program_source sources[] = {
+    {
+      .type = Shader::Type::fragment,
+      .path = frag_path,
+      .text = File_source{frag_path},
+      .define_block = define_block,
+    },
+    {
+      .type = Shader::Type::vertex,
+      .path = vert_path,
+      .text = File_source{vert_path},
+      .define_block = define_block,
+    },
   };
-  return Program(shaders);
+  return start_build(sources);
 }
 
-Program Program::from_compute(std::string_view compute_path) {
-  Shader shader[] = {Shader::from_file(Shader::Type::compute, compute_path)};
-  return Program(shader);
+Pending_program Pending_program::from_compute(std::string_view compute_path, const Defines& defines) {
+  const Program_source sources[] = {
+    {
+      .type = Shader::Type::compute,
+      .path = compute_path,
+      .text = File_source{compute_path},
+      .define_block = get_define_block(defines),
+    },
+  };
+  return start_build(sources);
 }
 
 std::string Program::get_printable_internals() const {
@@ -217,4 +611,153 @@ std::string Program::get_printable_internals() const {
   return result;
 }
 
+// ================================= Reloading programs =================================
+
+Program_reloader::Program_reloader() {
+  // Editors save either in place, or by renaming a new file over the old one
+  constexpr uint32_t events = IN_CLOSE_WRITE | IN_MOVED_TO;
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0 || inotify_add_watch(inotify_fd, File_source::source_dir, events) < 0) {
+    WARNING("Cannot watch '{}' for changes to shaders: {}", File_source::source_dir, std::strerror(errno));
+    if (inotify_fd >= 0) {
+      close(inotify_fd);
+      inotify_fd = -1;
+    }
+    return;
+  }
+
+  INFO(
+    "Watching '{}' for changes to shaders, to rebuild programs {}",
+    File_source::source_dir,
+    is_compile_parallel ? "in the background" : "(stalling, without GL_KHR_parallel_shader_compile)"
+  );
+}
+
+Program_reloader::~Program_reloader() {
+  if (inotify_fd >= 0) {
+    close(inotify_fd);
+  }
+}
+
+void Program_reloader::watch_compute(Program& program, std::string_view comp_path, Defines defines) {
+  watch(program, {{Shader::Type::compute, std::string{comp_path}}}, std::move(defines));
+}
+
+void Program_reloader::watch_frag_vert(
+  Program& program,
+  std::string_view frag_path,
+  std::string_view vert_path,
+  Defines defines
+) {
+  watch(
+    program,
+    {{Shader::Type::fragment, std::string{frag_path}}, {Shader::Type::vertex, std::string{vert_path}}},
+    std::move(defines)
+  );
+}
+
+void Program_reloader::watch(Program& program, std::vector<Stage> stages, Defines defines) {
+  Watched_program& watched = programs.emplace_back();
+  watched.target = &program;
+  watched.stages = std::move(stages);
+  watched.defines = std::move(defines);
+  for (const Stage& stage: watched.stages) {
+    watched.name += watched.name.empty() ? "" : " + ";
+    watched.name += stage.path;
+    const File_source source{stage.path};
+    const auto& dependencies = source.get_dependencies();
+    watched.dependencies.insert(watched.dependencies.end(), dependencies.begin(), dependencies.end());
+  }
+}
+
+void Program_reloader::poll() {
+  if (inotify_fd < 0) {
+    return;
+  }
+
+  std::vector<std::string> changed_files;
+  alignas(inotify_event) char buffer[4096];
+  ssize_t length;
+  while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t offset = 0; offset < length;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+      if (event->len > 0) {
+        changed_files.emplace_back(event->name);
+      }
+      offset += sizeof(inotify_event) + event->len;
+    }
+  }
+
+  for (Watched_program& watched: programs) {
+    const auto& dependencies = watched.dependencies;
+    const auto is_dependency = [&](const std::string& file) {
+      return std::find(dependencies.begin(), dependencies.end(), file) != dependencies.end();
+    };
+    const bool is_changed = std::any_of(changed_files.begin(), changed_files.end(), is_dependency);
+    if (is_changed) {
+      start_build(watched);
+    }
+
+    if (watched.build) {
+      GLint is_complete = true;
+      if (is_compile_parallel) {
+        glGetProgramiv(watched.build->program.get(), GL_COMPLETION_STATUS_KHR, &is_complete);
+      }
+      if (is_complete) {
+        finish_build(watched);
+      }
+    }
+  }
+}
+
+// Replaces the build in progress, if any
+void Program_reloader::start_build(Watched_program& watched) {
+  std::vector<std::string> texts;
+  std::vector<std::string> dependencies;
+  std::string error;
+  for (const Stage& stage: watched.stages) {
+    File_source source{stage.path, &error};
+    const auto& source_dependencies = source.get_dependencies();
+    dependencies.insert(dependencies.end(), source_dependencies.begin(), source_dependencies.end());
+    texts.push_back(std::move(source));
+  }
+
+  // Even if some file is missing, so that creating it counts as a change
+  watched.dependencies = std::move(dependencies);
+  watched.build.reset();
+  if (!error.empty()) {
+    WARNING("Cannot rebuild program '{}', keeping the old one: {}", watched.name, error);
+    return;
+  }
+
+  Build& build = watched.build.emplace();
+  build.start = std::chrono::steady_clock::now();
+  const std::string define_block = get_define_block(watched.defines);
+  for (size_t i = 0; i < watched.stages.size(); i++) {
+    const Stage& stage = watched.stages[i];
+    build.shaders.push_back(start_compiling_shader(stage.type, texts[i], stage.path, define_block));
+  }
+  build.program = Program(start_linking_program(build.shaders, false));
+}
+
+void Program_reloader::finish_build(Watched_program& watched) {
+  Build build = std::move(*watched.build);
+  watched.build.reset();
+
+  for (size_t i = 0; i < build.shaders.size(); i++) {
+    if (std::optional<std::string> log = get_compile_error(build.shaders[i])) {
+      WARNING("Shader {} failed to compile, keeping the old program. Log:\n{}", watched.stages[i].path, *log);
+      return;
+    }
+  }
+  if (std::optional<std::string> log = get_link_error(build.program.get())) {
+    WARNING("Program '{}' failed to link, keeping the old one. Log:\n{}", watched.name, *log);
+    return;
+  }
+
+  *watched.target = std::move(build.program);
+  const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - build.start;
+  INFO("Rebuilt program '{}' in {:.1f} ms", watched.name, elapsed.count());
+}
+
 }  // namespace gl
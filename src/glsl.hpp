@@ -2,9 +2,13 @@
 
 #include "util/unique.hpp"
 #include <GL/glew.h>
+#include <chrono>
+#include <concepts>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace gl {
 namespace detail {
@@ -21,6 +25,19 @@ struct Program_deleter {
 };
 }  // namespace detail
 
+// `#define name value`, inserted right after the shader prologue. The same source
+// compiles into a variant per set of defines, in which their values are constants
+struct Define {
+  std::string name;
+  std::string value;
+
+  Define(std::string_view name_, std::string_view value_) : name{name_}, value{value_} {}
+  template<std::integral T>
+  Define(std::string_view name_, T value_) : name{name_}, value{std::to_string(value_)} {}
+  Define(std::string_view name, float value);  // always with a decimal point, to stay a float
+};
+using Defines = std::vector<Define>;
+
 struct Shader: Unique_handle<GLuint, detail::Shader_deleter, 0> {
   enum class Type {
     fragment = GL_FRAGMENT_SHADER,
@@ -31,7 +48,7 @@ struct Shader: Unique_handle<GLuint, detail::Shader_deleter, 0> {
     tess_eval = GL_TESS_EVALUATION_SHADER,
   };
   using Unique_handle::Unique_handle;
-  static Shader from_file(Type, std::string_view file_path);
+  static Shader from_file(Type, std::string_view file_path, const Defines& = {});
   static Shader from_source(Type, std::string_view source);
 };
 
@@ -42,12 +59,112 @@ struct Program: Unique_handle<GLuint, detail::Program_deleter, 0> {
   explicit Program(std::span<const Shader>);
 
   // Shorthands for the two common cases
-  static Program from_frag_vert(std::string_view frag_path, std::string_view vert_path);
-  static Program from_compute(std::string_view comp_path);
+  // (the defines are the same for all stages)
+  static Program from_frag_vert(std::string_view frag_path, std::string_view vert_path, const Defines& = {});
+  static Program from_compute(std::string_view comp_path, const Defines& = {});
 
   // Get a non-portable string of printable characters in the output of glGetProgramBinary.
   // Nvidia drivers at least include a high-level assembly listing in there
   [[nodiscard]] std::string get_printable_internals() const;
 };
 
+struct Program_source;
+
+// A program that may still be compiling and linking in the background, once
+// `enable_parallel_shader_compile` has been called. Submitting several before finishing
+// any lets the driver build them all at once, and the caller do other work meanwhile
+class Pending_program {
+public:
+  static Pending_program from_frag_vert(
+    std::string_view frag_path,
+    std::string_view vert_path,
+    const Defines& = {}
+  );
+  static Pending_program from_compute(std::string_view comp_path, const Defines& = {});
+
+  // Whether `finish` would not block
+  [[nodiscard]] bool is_ready() const;
+
+  // Wait until the program is built, and die if that failed, as Program::from_* do
+  Program finish() &&;
+
+private:
+  Program program;
+  std::vector<Shader> shaders;  // empty if the program was loaded from the cache
+  std::vector<std::string> shader_names;
+  std::string cache_path;  // to store the binary at once built, empty to not
+  std::chrono::steady_clock::time_point start;
+
+  static Pending_program start_build(std::span<const Program_source>);
+};
+
+// Let the driver compile and link in background threads, with GL_KHR_parallel_shader_compile
+// (if supported). Only `Pending_program` and `Program_reloader` do not wait for them right away
+void enable_parallel_shader_compile();
+
+// Linked programs can be cached on disk as driver-specific binaries, which speeds up
+// startup where compiling is slow (notably llvmpipe). Entries are keyed by a hash of the
+// fully expanded sources, the shader prologue, defines and `driver_identity`, which should change
+// whenever the driver might (renderer, vendor and version strings).
+// Until this is called, or if `directory` is empty, programs are always compiled
+void enable_program_cache(std::string_view directory, std::string_view driver_identity);
+void log_program_cache_summary();
+
+// Rebuilds programs while the app runs, when a file they were built from changes.
+// The shader directory is watched with inotify, and a program is rebuilt when any of its
+// files, or of the files they #include (as of its last build), is written.
+// Rebuilds compile in the background where GL_KHR_parallel_shader_compile is supported:
+// the old program stays in use until the new one has linked, and if that fails,
+// the log is printed and the old program stays for good (until the next change).
+// Rebuilt programs do not go through the program cache
+class Program_reloader {
+public:
+  Program_reloader();
+  ~Program_reloader();
+
+  Program_reloader(const Program_reloader&) = delete;
+  Program_reloader& operator=(const Program_reloader&) = delete;
+
+  // Rebuild `program` from these files when they change, as from_compute and
+  // from_frag_vert would. It is replaced in place, so it must not move while watched
+  void watch_compute(Program& program, std::string_view comp_path, Defines = {});
+  void watch_frag_vert(
+    Program& program,
+    std::string_view frag_path,
+    std::string_view vert_path,
+    Defines = {}
+  );
+
+  // Pick up changed files and finished rebuilds, without blocking. Call once a frame
+  void poll();
+
+private:
+  struct Stage {
+    Shader::Type type;
+    std::string path;
+  };
+
+  struct Build {
+    std::vector<Shader> shaders;
+    Program program;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  struct Watched_program {
+    Program* target;
+    std::string name;  // for messages
+    std::vector<Stage> stages;
+    Defines defines;
+    std::vector<std::string> dependencies;
+    std::optional<Build> build;  // in progress
+  };
+
+  int inotify_fd = -1;
+  std::vector<Watched_program> programs;
+
+  void watch(Program&, std::vector<Stage>, Defines);
+  void start_build(Watched_program&);
+  void finish_build(Watched_program&);
+};
+
 }  // namespace gl
@@ -0,0 +1,100 @@
+#include "gpu_timer.hpp"
+#include "trace.hpp"
+#include <cmath>
+#include <fmt/format.h>
+#include <string>
+
+namespace gl {
+
+Gpu_timer::Gpu_timer(std::span<const std::string_view> pass_names) : passes(pass_names.size()) {
+  for (size_t i = 0; i < pass_names.size(); i++) {
+    passes[i].name = pass_names[i];
+  }
+}
+
+void Gpu_timer::begin(int pass_index) {
+  Pass& pass = passes[pass_index];
+  assert(!pass.running);
+  pass.running = true;
+
+  Frame_queries& frame = pass.frames[current_frame];
+  if (frame.num_used == frame.pairs.size()) {
+    frame.pairs.push_back({Query::create(GL_TIMESTAMP), Query::create(GL_TIMESTAMP)});
+  }
+  glQueryCounter(frame.pairs[frame.num_used].begin.get(), GL_TIMESTAMP);
+}
+
+void Gpu_timer::end(int pass_index) {
+  Pass& pass = passes[pass_index];
+  assert(pass.running);
+  pass.running = false;
+
+  Frame_queries& frame = pass.frames[current_frame];
+  glQueryCounter(frame.pairs[frame.num_used].end.get(), GL_TIMESTAMP);
+  frame.num_used++;
+}
+
+void Gpu_timer::collect(Pass& pass, Frame_queries& frame) {
+  if (frame.num_used == 0) {
+    pass.latest_ms = 0;
+    return;
+  }
+
+  GLuint64 total_ns = 0;
+  bool available = true;
+  for (unsigned i = 0; i < frame.num_used; i++) {
+    // Queries complete in order, so the last one in the pair being ready is enough
+    GLint end_ready = 0;
+    glGetQueryObjectiv(frame.pairs[i].end.get(), GL_QUERY_RESULT_AVAILABLE, &end_ready);
+    if (!end_ready) {
+      available = false;
+      break;
+    }
+    GLuint64 begin_ns, end_ns;
+    glGetQueryObjectui64v(frame.pairs[i].begin.get(), GL_QUERY_RESULT, &begin_ns);
+    glGetQueryObjectui64v(frame.pairs[i].end.get(), GL_QUERY_RESULT, &end_ns);
+    total_ns += end_ns - begin_ns;
+    trace::add_gpu_zone(pass.name, begin_ns, end_ns);
+  }
+
+  if (available) {
+    pass.latest_ms = total_ns * 1e-6;
+    pass.stats.add(pass.latest_ms);
+  } else {
+    pass.latest_ms = NAN;
+    num_dropped++;
+  }
+  frame.num_used = 0;
+}
+
+void Gpu_timer::end_frame() {
+  current_frame = (current_frame + 1) % frame_latency;
+  for (Pass& pass: passes) {
+    collect(pass, pass.frames[current_frame]);
+  }
+}
+
+void Gpu_timer::log_summary() const {
+  std::string summary;
+  auto out = std::back_inserter(summary);
+  for (const Pass& pass: passes) {
+    if (!pass.stats.empty()) {
+      fmt::format_to(
+        out,
+        FMT_STRING(" {} {:.3f}/{:.3f}"),
+        pass.name,
+        pass.stats.mean(),
+        pass.stats.percentile(0.99)
+      );
+    }
+  }
+  if (summary.empty()) {
+    return;
+  }
+  INFO("GPU ms per frame (avg/p99):{}", summary);
+  if (num_dropped > 0) {
+    WARNING("{} GPU timing samples were not ready in time and got dropped", num_dropped);
+  }
+}
+
+}  // namespace gl
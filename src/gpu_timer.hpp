@@ -0,0 +1,67 @@
+#pragma once
+
+#include "gl.hpp"
+#include "util/rolling_stats.hpp"
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace gl {
+// Measures GPU time spent in a fixed set of passes, with a pair of GL_TIMESTAMP queries
+// around each (time elapsed queries cannot nest, timestamps can).
+//
+// Queries are kept in a ring of `frame_latency` frames, and a frame's results are only
+// read back when its slot comes around again, and only if they are already available:
+// a late result gets dropped rather than stall the pipeline.
+// A pass may run zero or more times a frame; its sample for the frame is the sum.
+// While tracing, each run of a pass also goes into the trace (see trace.hpp)
+class Gpu_timer {
+public:
+  constexpr static int frame_latency = 4;
+  constexpr static size_t stats_window = 240;
+  using Stats = Rolling_stats<stats_window>;
+
+  explicit Gpu_timer(std::span<const std::string_view> pass_names);
+
+  void begin(int pass);
+  void end(int pass);
+  void end_frame();
+
+  [[nodiscard]] const Stats& get_stats(int pass) const {
+    return passes[pass].stats;
+  }
+
+  // Of the frame `frame_latency - 1` frames before the latest one to end (whose slot the latest
+  // end_frame() reused): 0 if the pass did not run, NaN if its results were dropped
+  [[nodiscard]] double get_latest_ms(int pass) const {
+    return passes[pass].latest_ms;
+  }
+
+  // Log average and p99 of each pass over the latest frames
+  void log_summary() const;
+
+private:
+  struct Query_pair {
+    Query begin, end;
+  };
+
+  struct Frame_queries {
+    std::vector<Query_pair> pairs;
+    unsigned num_used = 0;
+  };
+
+  struct Pass {
+    std::string_view name;
+    Frame_queries frames[frame_latency];
+    Stats stats;
+    double latest_ms = 0;
+    bool running = false;
+  };
+
+  std::vector<Pass> passes;
+  int current_frame = 0;
+  unsigned long num_dropped = 0;
+
+  void collect(Pass&, Frame_queries&);
+};
+}  // namespace gl
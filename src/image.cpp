@@ -0,0 +1,29 @@
+#include "image.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+namespace image {
+
+Rgb_difference compare_rgb(
+  std::span<const unsigned char> expected,
+  std::span<const unsigned char> actual,
+  int tolerance
+) {
+  assert(expected.size() == actual.size());
+  Rgb_difference diff{.num_total = expected.size() / 3};
+  size_t sum = 0;
+  for (size_t i = 0; i + 3 <= expected.size(); i += 3) {
+    int pixel_max = 0;
+    for (size_t c = i; c < i + 3; c++) {
+      const int channel_diff = std::abs(int(expected[c]) - int(actual[c]));
+      pixel_max = std::max(pixel_max, channel_diff);
+      sum += channel_diff;
+    }
+    diff.num_differing += (pixel_max > tolerance);
+    diff.max = std::max(diff.max, pixel_max);
+  }
+  diff.mean = expected.empty() ? 0 : double(sum) / expected.size();
+  return diff;
+}
+}  // namespace image
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+// Comparison of images as `gfx::fieldviz_read_image` returns them (8-bit RGB),
+// shared by the regression tests and the benchmarks
+namespace image {
+
+struct Rgb_difference {
+  size_t num_differing = 0;  // pixels with a channel off by more than the tolerance
+  size_t num_total = 0;
+  int max = 0;  // of any channel
+  double mean = 0;  // absolute, over all channels of all pixels
+};
+
+// Both images are the same size
+Rgb_difference compare_rgb(
+  std::span<const unsigned char> expected,
+  std::span<const unsigned char> actual,
+  int tolerance
+);
+}  // namespace image
@@ -1,6 +1,14 @@
 #include "gfx.hpp"
-#include <charconv>
+#include "trace.hpp"
+#include "util/args.hpp"
+#include "util/rolling_stats.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <thread>
 
@@ -11,6 +19,7 @@ struct Input_state {
   bool should_update_field = true;
 
   Input_state& poll_events() {
+    TRACE_SCOPE("poll_events");
     for (SDL_Event event; SDL_PollEvent(&event);) {
       gfx::handle_sdl_event(event);
       switch (event.type) {
@@ -28,6 +37,12 @@ struct Input_state {
         case SDLK_f:
           should_update_field ^= 1;
           break;
+        case SDLK_s:
+          gfx::fieldviz_save_snapshot();
+          break;
+        case SDLK_r:
+          gfx::fieldviz_toggle_renderer();
+          break;
         case SDLK_d:
           if (event.key.keysym.mod & KMOD_SHIFT) {
             asm("int3" :::);
@@ -41,40 +56,216 @@ struct Input_state {
   }
 };
 
-void wait_fps(int fps) {
-  static auto next = std::chrono::steady_clock::now();
-  next += std::chrono::microseconds{1000'000 / fps};
-  std::this_thread::sleep_until(next);
-}
+// Paces frames to the display's refresh rate (or some other rate), and starts each one as
+// late as still lets it be presented in time, so that the input it acts on is fresh.
+// Frames end with a deadline: with vsync, it is one period after the swap of the previous
+// frame returned, which was at a refresh, so that the schedule stays in phase with the
+// display; without vsync, it is one period after the previous deadline. Before a frame,
+// the pacer sleeps until its deadline minus the time frames recently took (up to the swap),
+// minus a margin for the GPU and the swap. How long frames took is a percentile of the
+// recent ones, recomputed every so often rather than every frame. The margin grows whenever
+// a frame misses its deadline, and tightens again a little at a time while none do,
+// to find what is enough.
+// A frame that is behind schedule does not sleep at all, and the schedule continues from it
+// rather than try to catch up with a burst of frames
+class Frame_pacer {
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
 
-namespace arg {
-using std::string_view;
+  constexpr static double initial_margin = 2e-3;
+  constexpr static double min_margin = 0.5e-3;
+  constexpr static double margin_increase = 1e-3;
+  constexpr static double margin_decrease = 0.25e-3;
+  constexpr static Seconds margin_decrease_interval{5};  // without missing a deadline
+  constexpr static double work_percentile = 0.95;
+  constexpr static unsigned long work_estimate_interval = 30;  // frames between recomputing it
+
+  Seconds period;
+  bool is_vsync;
+  double margin = initial_margin;
+  Clock::time_point margin_change_time = Clock::now();
+  Rolling_stats<120> work_seconds;
+  unsigned long num_work_samples = 0;
+  double work_estimate = 0;  // `work_percentile` of `work_seconds`
+  Clock::time_point frame_start = Clock::now();
+  Clock::time_point deadline = frame_start + std::chrono::duration_cast<Clock::duration>(period);
+
+public:
+  unsigned long num_frames = 0;
+  unsigned long num_late = 0;  // started after they should have, with no time to sleep
+  unsigned long num_missed = 0;  // presented over half a period after their deadline
+
+  Frame_pacer(unsigned fps, bool is_vsync_) : period{1.0 / fps}, is_vsync{is_vsync_} {}
+
+  // Sleep until it is time to start the next frame. Returns the time since the previous one started
+  double wait() {
+    TRACE_SCOPE("wait_frame");
+    const double lead = work_estimate + margin;
+    const Clock::time_point wake = deadline - std::chrono::duration_cast<Clock::duration>(Seconds{lead});
+    if (Clock::now() < wake) {
+      std::this_thread::sleep_until(wake);
+    } else if (num_frames > 0) {
+      num_late++;
+    }
+    const Clock::time_point now = Clock::now();
+    const double elapsed = Seconds(now - frame_start).count();
+    frame_start = now;
+    return elapsed;
+  }
 
-struct Arg_parse_exception {
-  string_view subject;
-  string_view defect;
+  // Call once the frame is ready to present
+  void frame_submitted() {
+    work_seconds.add(Seconds(Clock::now() - frame_start).count());
+    // Every frame at first, while there are few samples and the estimate is the least settled
+    num_work_samples++;
+    if (num_work_samples <= work_estimate_interval || num_work_samples % work_estimate_interval == 0) {
+      work_estimate = work_seconds.percentile(work_percentile);
+    }
+  }
+
+  // Call once the frame is presented
+  void frame_presented() {
+    const Clock::time_point now = Clock::now();
+    if (num_frames > 0 && now > deadline + period / 2) {
+      num_missed++;
+      margin = std::min(margin + margin_increase, period.count() / 2);
+      margin_change_time = now;
+    } else if (now - margin_change_time > margin_decrease_interval) {
+      margin = std::max(margin - margin_decrease, min_margin);
+      margin_change_time = now;
+    }
+    num_frames++;
+
+    const auto period_duration = std::chrono::duration_cast<Clock::duration>(period);
+    deadline = is_vsync ? now + period_duration : std::max(deadline, now) + period_duration;
+  }
+
+  void report(unsigned fps) const {
+    INFO(
+      "Paced {} frames at {} Hz{}: {} started late, {} missed their deadline",
+      num_frames,
+      fps,
+      is_vsync ? " with vsync" : "",
+      num_late,
+      num_missed
+    );
+  }
 };
 
-void parse_number(string_view arg, auto& x) {
-  auto [ptr, ec] = std::from_chars(arg.begin(), arg.end(), x);
-  if (ec != std::errc{}) {
-    throw Arg_parse_exception{.subject = arg, .defect = "is not a number"};
+struct App_config {
+  gfx::Config gfx;
+  unsigned num_frames = 0;  // 0 for unlimited
+  unsigned display_fps = 0;  // 0 for `gfx::get_frame_rate()`
+  unsigned max_ticks_per_frame = 0;  // 0 for 4x as many as the rates call for
+  std::string trace_path;  // record a trace of CPU and GPU work there, see trace.hpp
+};
+
+// Fixed timestep: the simulation runs at its own rate, taking as many ticks in a frame
+// as there are tick periods in the time since the previous frame (possibly none).
+// When it cannot keep up, it falls behind real time rather than taking ever longer frames
+class Fixed_timestep {
+  double tick_rate;
+  double accumulated_ticks = 0;
+  unsigned max_ticks_per_frame;
+
+public:
+  unsigned long num_dropped_ticks = 0;
+
+  Fixed_timestep(unsigned tick_rate_, unsigned max_ticks_per_frame_) :
+    tick_rate{double(tick_rate_)}, max_ticks_per_frame{max_ticks_per_frame_} {}
+
+  // Number of ticks to run for a frame that took `seconds`
+  unsigned advance(double seconds) {
+    // The epsilon keeps rates that divide evenly from losing a tick to rounding
+    accumulated_ticks += seconds * tick_rate;
+    double whole_ticks = std::floor(accumulated_ticks + 1e-6);
+    accumulated_ticks = std::max(0.0, accumulated_ticks - whole_ticks);
+
+    unsigned ticks = whole_ticks;
+    if (ticks > max_ticks_per_frame) {
+      if (num_dropped_ticks == 0) {
+        WARNING("Simulation cannot keep up with {} ticks/s, falling behind real time", tick_rate);
+      }
+      num_dropped_ticks += ticks - max_ticks_per_frame;
+      ticks = max_ticks_per_frame;
+    }
+    return ticks;
+  }
+};
+}  // namespace
+
+namespace arg {
+void parse_renderer(string_view arg, gfx::Renderer& x) {
+  if (arg == "lines") {
+    x = gfx::Renderer::lines;
+  } else if (arg == "splat") {
+    x = gfx::Renderer::splat;
+  } else {
+    throw Arg_parse_exception{.subject = arg, .defect = "is not a renderer (lines, splat)"};
   }
 }
 
-void parse_resolution(string_view arg, auto& x, auto& y) {
-  size_t delim = arg.find('x');
-  if (delim == arg.npos) {
-    throw Arg_parse_exception{.subject = arg, .defect = "has no delimiter (e.g. 200x200)"};
+void parse_particle_format(string_view arg, gfx::Particle_format& x) {
+  if (arg == "f32") {
+    x = gfx::Particle_format::f32;
+  } else if (arg == "f16") {
+    x = gfx::Particle_format::f16;
+  } else if (arg == "unorm16") {
+    x = gfx::Particle_format::unorm16;
+  } else {
+    throw Arg_parse_exception{.subject = arg, .defect = "is not a particle format (f32, f16, unorm16)"};
   }
-  parse_number(arg.substr(0, delim), x);
-  parse_number(arg.substr(delim + 1), y);
 }
 
-gfx::Config get_config(int argc, const char* const* argv) {
-  gfx::Config cfg;
+void parse_integrator(string_view arg, sim::Integrator& x) {
+  if (arg == "euler") {
+    x = sim::Integrator::euler;
+  } else if (arg == "rk2") {
+    x = sim::Integrator::rk2;
+  } else if (arg == "rk4") {
+    x = sim::Integrator::rk4;
+  } else {
+    throw Arg_parse_exception{.subject = arg, .defect = "is not an integrator (euler, rk2, rk4)"};
+  }
+}
 
-  const auto process_argument = [&cfg](string_view arg) {
+void parse_bake_format(string_view arg, bool& half) {
+  if (arg == "rg32f") {
+    half = false;
+  } else if (arg == "rg16f") {
+    half = true;
+  } else {
+    throw Arg_parse_exception{.subject = arg, .defect = "is not a bake format (rg32f, rg16f)"};
+  }
+}
+
+// Per XDG, $XDG_CACHE_HOME or else ~/.cache
+std::string get_default_cache_dir() {
+  if (const char* xdg_cache = std::getenv("XDG_CACHE_HOME"); xdg_cache && *xdg_cache) {
+    return std::string{xdg_cache} + "/field-sim";
+  }
+  if (const char* home = std::getenv("HOME"); home && *home) {
+    return std::string{home} + "/.cache/field-sim";
+  }
+  return {};
+}
+
+void parse_capture_format(string_view arg, bool& raw_rgb) {
+  if (arg == "y4m") {
+    raw_rgb = false;
+  } else if (arg == "rgb") {
+    raw_rgb = true;
+  } else {
+    throw Arg_parse_exception{.subject = arg, .defect = "is not a capture format (y4m, rgb)"};
+  }
+}
+
+App_config get_config(int argc, const char* const* argv) {
+  App_config app_cfg;
+  gfx::Config& cfg = app_cfg.gfx;
+  cfg.cache_dir = get_default_cache_dir();
+
+  const auto process_argument = [&app_cfg, &cfg](string_view arg) {
     if (!arg.starts_with("--")) {
       throw Arg_parse_exception{.subject = arg, .defect = "does not start with --"};
     }
@@ -83,6 +274,57 @@ gfx::Config get_config(int argc, const char* const* argv) {
       cfg.debug = true;
     } else if (arg == "no-debug") {
       cfg.debug = false;
+    } else if (arg == "headless") {
+      cfg.headless = true;
+    } else if (arg == "gpu-timing") {
+      cfg.gpu_timing = true;
+    } else if (arg == "validate") {
+      cfg.validate = true;
+    } else if (arg == "hot-reload") {
+      cfg.hot_reload = true;
+    } else if (arg == "dynamic-res") {
+      cfg.dynamic_resolution = true;
+    } else if (arg.starts_with("dynamic-res=")) {
+      cfg.dynamic_resolution = true;
+      parse_number(arg.substr(sizeof("dynamic-res=") - 1), cfg.frame_time_target_ms);
+    } else if (arg.starts_with("capture=")) {
+      cfg.capture_path = arg.substr(sizeof("capture=") - 1);
+    } else if (arg.starts_with("capture-format=")) {
+      parse_capture_format(arg.substr(sizeof("capture-format=") - 1), cfg.capture_raw_rgb);
+    } else if (arg == "autotune") {
+      cfg.autotune = true;
+    } else if (arg.starts_with("snapshot=")) {
+      cfg.snapshot_path = arg.substr(sizeof("snapshot=") - 1);
+    } else if (arg.starts_with("restore=")) {
+      cfg.restore_path = arg.substr(sizeof("restore=") - 1);
+    } else if (arg.starts_with("cache-dir=")) {
+      cfg.cache_dir = arg.substr(sizeof("cache-dir=") - 1);
+    } else if (arg == "no-cache") {
+      cfg.cache_dir.clear();
+    } else if (arg.starts_with("bake=")) {
+      parse_resolution(arg.substr(sizeof("bake=") - 1), cfg.field_bake_x, cfg.field_bake_y);
+    } else if (arg.starts_with("bake-format=")) {
+      parse_bake_format(arg.substr(sizeof("bake-format=") - 1), cfg.field_bake_half);
+    } else if (arg.starts_with("backend=")) {
+      gfx::parse_backend(arg.substr(sizeof("backend=") - 1), cfg.backend);
+    } else if (arg.starts_with("renderer=")) {
+      parse_renderer(arg.substr(sizeof("renderer=") - 1), cfg.renderer);
+    } else if (arg.starts_with("particle-format=")) {
+      parse_particle_format(arg.substr(sizeof("particle-format=") - 1), cfg.particle_format);
+    } else if (arg.starts_with("integrator=")) {
+      parse_integrator(arg.substr(sizeof("integrator=") - 1), cfg.integrator);
+    } else if (arg.starts_with("substeps=")) {
+      parse_number(arg.substr(sizeof("substeps=") - 1), cfg.substeps);
+    } else if (arg.starts_with("sim-rate=")) {
+      parse_number(arg.substr(sizeof("sim-rate=") - 1), cfg.sim_rate);
+    } else if (arg.starts_with("fps=")) {
+      parse_number(arg.substr(sizeof("fps=") - 1), app_cfg.display_fps);
+    } else if (arg.starts_with("max-ticks-per-frame=")) {
+      parse_number(arg.substr(sizeof("max-ticks-per-frame=") - 1), app_cfg.max_ticks_per_frame);
+    } else if (arg.starts_with("trace=")) {
+      app_cfg.trace_path = arg.substr(sizeof("trace=") - 1);
+    } else if (arg.starts_with("frames=")) {
+      parse_number(arg.substr(sizeof("frames=") - 1), app_cfg.num_frames);
     } else if (arg.starts_with("res=")) {
       parse_resolution(arg.substr(sizeof("res=") - 1), cfg.screen_res_x, cfg.screen_res_y);
     } else if (arg.starts_with("grid=")) {
@@ -91,6 +333,10 @@ gfx::Config get_config(int argc, const char* const* argv) {
       parse_number(arg.substr(sizeof("life=") - 1), cfg.particle_lifetime);
     } else if (arg.starts_with("spacing=")) {
       parse_number(arg.substr(sizeof("spacing=") - 1), cfg.particle_spacing);
+    } else if (arg.starts_with("actor-ring=")) {
+      parse_number(arg.substr(sizeof("actor-ring=") - 1), cfg.actors_ring_size);
+    } else if (arg.starts_with("actors=")) {
+      parse_number(arg.substr(sizeof("actors=") - 1), cfg.num_actors);
     } else {
       throw Arg_parse_exception{.subject = arg, .defect = "is not a valid option"};
     }
@@ -105,20 +351,110 @@ gfx::Config get_config(int argc, const char* const* argv) {
     }
   }
 
-  return cfg;
+  if (cfg.sim_rate == 0) {
+    WARNING("Simulation rate must be positive, using 60");
+    cfg.sim_rate = 60;
+  }
+  if (cfg.substeps == 0) {
+    WARNING("There must be at least one substep, using 1");
+    cfg.substeps = 1;
+  }
+  cfg.capture_fps = app_cfg.display_fps;
+  if (cfg.dynamic_resolution && cfg.frame_time_target_ms == 0 && app_cfg.display_fps) {
+    cfg.frame_time_target_ms = 1000.0f / app_cfg.display_fps;
+  }
+
+  return app_cfg;
 }
 }  // namespace arg
+
+namespace {
+// Throughput over the whole run, reported at the end of headless runs
+struct Run_stats {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point start_time = Clock::now();
+  unsigned long num_frames = 0;
+  unsigned long num_ticks = 0;
+
+  void report() const {
+    double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    double particles = gfx::fieldviz_get_total_particles();
+    INFO(
+      "{} frames, {} ticks in {:.3f} s: {:.1f} frames/s, {:.1f} ticks/s, {:.4g} particles/s",
+      num_frames,
+      num_ticks,
+      seconds,
+      num_frames / seconds,
+      num_ticks / seconds,
+      num_ticks * particles / seconds
+    );
+  }
+};
 }  // namespace
 
 int main(int argc, char** argv) {
-  gfx::Init_lock gfx(arg::get_config(argc, argv));
+  const App_config cfg = arg::get_config(argc, argv);
+  if (!cfg.trace_path.empty()) {
+    trace::start(cfg.trace_path);
+  }
+  if (!cfg.gfx.capture_path.empty()) {
+    // A reader going away from the other end of a capture pipe should end the capture, not the program
+    std::signal(SIGPIPE, SIG_IGN);
+  }
+  gfx::Init_lock gfx(cfg.gfx);
 
-  for (Input_state input; !input.poll_events().should_quit;) {
-    wait_fps(60);
-    if (input.should_update_field) {
+  const unsigned display_fps = cfg.display_fps ? cfg.display_fps : gfx::get_frame_rate();
+  const unsigned max_ticks_per_frame = cfg.max_ticks_per_frame
+    ? cfg.max_ticks_per_frame
+    : 4 * ((cfg.gfx.sim_rate + display_fps - 1) / display_fps);
+
+  // Headless runs are for measuring, so they go as fast as possible,
+  // on a virtual clock where each frame takes exactly its nominal time
+  std::optional<Frame_pacer> pacer;
+  if (!cfg.gfx.headless) {
+    pacer.emplace(display_fps, gfx::is_vsync_enabled());
+  }
+
+  Run_stats stats;
+  Fixed_timestep timestep(cfg.gfx.sim_rate, max_ticks_per_frame);
+  for (Input_state input;;) {
+    const double frame_seconds = pacer ? pacer->wait() : 1.0 / display_fps;
+    if (input.poll_events().should_quit) {
+      break;
+    }
+
+    const unsigned num_ticks = input.should_update_field ? timestep.advance(frame_seconds) : 0;
+    for (unsigned i = 0; i < num_ticks; i++) {
+      if (i > 0) {
+        gfx::fieldviz_paint();
+      }
       gfx::fieldviz_update();
     }
+    stats.num_ticks += num_ticks;
+
     gfx::fieldviz_draw(input.should_clear_frame);
+    if (pacer) {
+      pacer->frame_submitted();
+    }
     gfx::present_frame();
+    if (pacer) {
+      pacer->frame_presented();
+    }
+    if (++stats.num_frames == cfg.num_frames) {
+      break;
+    }
+  }
+
+  if (timestep.num_dropped_ticks > 0) {
+    INFO("Dropped {} ticks to keep frames short", timestep.num_dropped_ticks);
+  }
+  if (pacer) {
+    pacer->report(display_fps);
+  }
+  if (cfg.gfx.headless) {
+    gfx::wait_idle();
+    stats.report();
+    gfx::report_stats();
   }
+  trace::finish();
 }
@@ -0,0 +1,369 @@
+#include "sim.hpp"
+#include "sim_simd.hpp"
+#include "trace.hpp"
+#include "util/util.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+vec2 velocity_at(vec2 p, const Step_params& params) {
+  vec2 vel{0, 0};
+
+  // Linear falloff of force
+  for (const Actor& v: params.vortices) {
+    vec2 r = p - v.position;
+    vel += v.force * vec2(-r.y, r.x) / glm::dot(r, r);
+  }
+  for (const Actor& pusher: params.pushers) {
+    vec2 r = p - pusher.position;
+    vel += pusher.force * r / glm::dot(r, r);
+  }
+
+  float vel2 = glm::dot(vel, vel);
+  if (vel2 > max_velocity * max_velocity) {
+    vel *= max_velocity / std::sqrt(vel2);
+  }
+
+  return vel;
+}
+
+vec2 advance(vec2 p, const Step_params& params) {
+  const float h = params.time_step / params.substeps;
+  const float half_h = h * 0.5f;
+  const float sixth_h = h / 6;
+  for (unsigned i = 0; i < params.substeps; i++) {
+    switch (params.integrator) {
+    case Integrator::euler:
+      p = p + velocity_at(p, params) * h;
+      break;
+    case Integrator::rk2:
+      p = p + velocity_at(p + velocity_at(p, params) * half_h, params) * h;
+      break;
+    case Integrator::rk4: {
+      const vec2 k1 = velocity_at(p, params);
+      const vec2 k2 = velocity_at(p + k1 * half_h, params);
+      const vec2 k3 = velocity_at(p + k2 * half_h, params);
+      const vec2 k4 = velocity_at(p + k3 * h, params);
+      p = p + (k1 + k2 * 2.0f + k3 * 2.0f + k4) * sixth_h;
+      break;
+    }
+    }
+  }
+  return p;
+}
+
+std::string_view get_integrator_name(Integrator integrator) {
+  switch (integrator) {
+  case Integrator::euler:
+    return "euler";
+  case Integrator::rk2:
+    return "rk2";
+  case Integrator::rk4:
+    return "rk4";
+  }
+  return "unknown";
+}
+
+unsigned get_field_evaluations(Integrator integrator) {
+  switch (integrator) {
+  case Integrator::euler:
+    return 1;
+  case Integrator::rk2:
+    return 2;
+  case Integrator::rk4:
+    return 4;
+  }
+  return 0;
+}
+
+static vec2 sample_bilinear(std::span<const vec2> texels, Resolution size, vec2 uv) {
+  const vec2 t = uv * vec2(size) - vec2(0.5f);
+  const vec2 t0 = glm::floor(t);
+  const vec2 f = t - t0;
+  const auto texel = [&](float x, float y) {
+    unsigned cx = glm::clamp(x, 0.0f, size.x - 1.0f);
+    unsigned cy = glm::clamp(y, 0.0f, size.y - 1.0f);
+    return texels[cy * size.x + cx];
+  };
+  const vec2 bottom = glm::mix(texel(t0.x, t0.y), texel(t0.x + 1, t0.y), f.x);
+  const vec2 top = glm::mix(texel(t0.x, t0.y + 1), texel(t0.x + 1, t0.y + 1), f.x);
+  return glm::mix(bottom, top, f.y);
+}
+
+Field_error measure_baked_field_error(
+  std::span<const vec2> texels,
+  Resolution bake_size,
+  Resolution grid_size,
+  const Step_params& params
+) {
+  // Sample between particle spawn points, thinning out to a bounded number of samples
+  constexpr unsigned max_samples_per_axis = 256;
+  const Resolution stride = glm::max(grid_size / max_samples_per_axis, Resolution(1));
+
+  std::vector<double> errors;
+  for (unsigned y = 0; y < grid_size.y; y += stride.y) {
+    for (unsigned x = 0; x < grid_size.x; x += stride.x) {
+      const vec2 p = vec2(x, y) + vec2(0.5f);
+      const vec2 baked = sample_bilinear(texels, bake_size, p / vec2(grid_size));
+      const float error = glm::distance(baked, velocity_at(p, params));
+      // Exactly on an actor, the analytic velocity is undefined
+      if (!std::isnan(error)) {
+        errors.push_back(error);
+      }
+    }
+  }
+  if (errors.empty()) {
+    return {};
+  }
+
+  double sum = 0;
+  for (double e: errors) {
+    sum += e;
+  }
+  auto p99 = errors.begin() + (errors.size() - 1) * 99 / 100;
+  std::nth_element(errors.begin(), p99, errors.end());
+  return {
+    .mean = sum / errors.size(),
+    .p99 = *p99,
+    .max = *std::max_element(p99, errors.end()),
+    .num_samples = errors.size(),
+  };
+}
+
+void Scene::update(unsigned tick, Resolution grid_size) {
+  float w = grid_size.x;
+  float h = grid_size.y;
+  float sec = tick / tick_rate;
+
+  vortices.clear();
+  pushers.clear();
+  const auto has_room = [&] {
+    return num_actors == 0 || vortices.size() + pushers.size() < num_actors;
+  };
+  const auto add_vortex = [&](float x, float y, float f) {
+    if (has_room()) {
+      vortices.push_back({.position = {w * x, h * y}, .force = f});
+    }
+  };
+  const auto add_pusher = [&](float x, float y, float f) {
+    if (has_room()) {
+      pushers.push_back({.position = {w * x, h * y}, .force = f});
+    }
+  };
+
+  add_vortex(0.5, 0.5, 200);
+  add_vortex(0.2, 0.1, 70 * sin(sec * 0.5));
+  add_vortex(0.3, 0.3, 70 * cos(sec * 0.5));
+  add_pusher(0.3, 0.9, 200 * sin(sec));
+  add_pusher(0.7, 0.5, 75 + 75 * sin(sec * 1.5f));
+
+  if (num_actors == 0) {
+    return;
+  }
+
+  // Weaker actors scattered over the field, alternating between the two kinds
+  const auto random_unit = [](uint32_t seed) {
+    return particle_hash(seed) * 0x1p-32f;
+  };
+  for (uint32_t i = 0; has_room(); i++) {
+    float x = random_unit(3 * i);
+    float y = random_unit(3 * i + 1);
+    float f = 40 * random_unit(3 * i + 2) - 20;
+    if (i % 2 == 0) {
+      add_vortex(x, y, f);
+    } else {
+      add_pusher(x, y, f);
+    }
+  }
+}
+
+// Split [0, size) into one contiguous range per thread, with boundaries on multiples
+// of `align` so that threads do not share cache lines
+template<typename F>
+static void parallel_ranges(Thread_pool& threads, size_t size, size_t align, F&& f) {
+  const unsigned num_threads = threads.size();
+  const size_t chunk = ((size + num_threads - 1) / num_threads + align - 1) / align * align;
+  threads.run([&](unsigned thread_index) {
+    size_t first = std::min(size, thread_index * chunk);
+    size_t last = std::min(size, first + chunk);
+    if (first < last) {
+      TRACE_SCOPE("simulate_range");
+      f(first, last);
+    }
+  });
+}
+
+// ================================= Scalar backend =================================
+
+Cpu_simulation::Cpu_simulation(Resolution grid_size_, unsigned num_threads) :
+  grid_size{grid_size_},
+  threads(num_threads) {}
+
+void Cpu_simulation::step_range(std::span<Particle> particles, unsigned first, const Step_params& params)
+  const {
+  for (unsigned i = 0; i < particles.size(); i++) {
+    const uint32_t id = first + i;
+
+    // Reset the particle to its initial position every so often,
+    // with a pseudo-random phase shift for each particle
+    vec2 old_position = ((params.tick - particle_hash(id)) % params.particle_lifetime == 0)
+      ? spawn_position(id, grid_size)
+      : particles[i].front;
+
+    particles[i].front = advance(old_position, params);
+    particles[i].back = old_position;
+  }
+}
+
+void Cpu_simulation::step(std::span<Particle> particles, const Step_params& params) {
+  parallel_ranges(threads, particles.size(), 1, [&](size_t first, size_t last) {
+    step_range(particles.subspan(first, last - first), first, params);
+  });
+}
+
+// =============================== Vectorized backend ===============================
+
+std::string_view get_isa_name(Isa isa) {
+  switch (isa) {
+  case Isa::scalar:
+    return "scalar";
+  case Isa::sse4_2:
+    return "SSE4.2";
+  case Isa::avx2:
+    return "AVX2";
+  case Isa::avx512:
+    return "AVX-512";
+  }
+  return "unknown";
+}
+
+bool is_isa_supported(Isa isa) {
+  switch (isa) {
+  case Isa::scalar:
+    return true;
+  case Isa::sse4_2:
+    return __builtin_cpu_supports("sse4.2");
+  case Isa::avx2:
+    return __builtin_cpu_supports("avx2");
+  case Isa::avx512:
+    return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+}
+
+Isa detect_best_isa() {
+  for (Isa isa: {Isa::avx512, Isa::avx2, Isa::sse4_2}) {
+    if (is_isa_supported(isa)) {
+      return isa;
+    }
+  }
+  return Isa::scalar;
+}
+
+namespace simd {
+static bool should_respawn(const Soa_step& s, size_t i) {
+  uint32_t phase = (s.tick >= s.hash[i]) ? s.tick_phase : s.wrapped_tick_phase;
+  return s.hash_phase[i] == phase;
+}
+
+void step_scalar(const Soa_step& s, size_t first, size_t last) {
+  const Step_params params = {
+    .tick = s.tick,
+    .particle_lifetime = 0,  // respawns are decided here
+    .time_step = s.time_step,
+    .vortices = {s.vortices, s.num_vortices},
+    .pushers = {s.pushers, s.num_pushers},
+    .integrator = s.integrator,
+    .substeps = s.substeps,
+  };
+  for (size_t i = first; i < last; i++) {
+    vec2 old_position = should_respawn(s, i)
+      ? spawn_position(i, s.grid_size)
+      : vec2{s.front_x[i], s.front_y[i]};
+
+    vec2 new_position = advance(old_position, params);
+    s.front_x[i] = new_position.x;
+    s.front_y[i] = new_position.y;
+    s.out[i] = {.front = new_position, .back = old_position};
+  }
+}
+
+Step_kernel* get_kernel(Isa isa) {
+  switch (isa) {
+  case Isa::scalar:
+    return step_scalar;
+  case Isa::sse4_2:
+    return step_sse4_2;
+  case Isa::avx2:
+    return step_avx2;
+  case Isa::avx512:
+    return step_avx512;
+  }
+  return step_scalar;
+}
+}  // namespace simd
+
+Simd_simulation::Simd_simulation(Resolution grid_size_, Isa isa_, unsigned num_threads) :
+  grid_size{grid_size_},
+  isa{isa_},
+  threads(num_threads) {
+  if (!is_isa_supported(isa)) {
+    FATAL("This CPU does not support {}", get_isa_name(isa));
+  }
+
+  const size_t num_particles = grid_size.x * grid_size.y;
+  front_x.resize(num_particles);
+  front_y.resize(num_particles);
+  hash.resize(num_particles);
+  hash_phase.resize(num_particles);
+  for (uint32_t id = 0; id < num_particles; id++) {
+    hash[id] = particle_hash(id);
+  }
+}
+
+void Simd_simulation::set_particles(std::span<const Particle> particles) {
+  assert(particles.size() == front_x.size());
+  for (size_t i = 0; i < particles.size(); i++) {
+    front_x[i] = particles[i].front.x;
+    front_y[i] = particles[i].front.y;
+  }
+}
+
+void Simd_simulation::step(const Step_params& params, std::span<Particle> out) {
+  assert(out.size() == front_x.size());
+
+  if (phase_lifetime != params.particle_lifetime) {
+    phase_lifetime = params.particle_lifetime;
+    for (size_t i = 0; i < hash.size(); i++) {
+      hash_phase[i] = hash[i] % phase_lifetime;
+    }
+  }
+
+  const simd::Soa_step s = {
+    .front_x = front_x.data(),
+    .front_y = front_y.data(),
+    .hash = hash.data(),
+    .hash_phase = hash_phase.data(),
+    .out = out.data(),
+    .tick = params.tick,
+    .tick_phase = params.tick % phase_lifetime,
+    .wrapped_tick_phase = static_cast<uint32_t>((params.tick + (uint64_t{1} << 32)) % phase_lifetime),
+    .time_step = params.time_step,
+    .vortices = params.vortices.data(),
+    .num_vortices = params.vortices.size(),
+    .pushers = params.pushers.data(),
+    .num_pushers = params.pushers.size(),
+    .integrator = params.integrator,
+    .substeps = params.substeps,
+    .grid_size = grid_size,
+  };
+
+  simd::Step_kernel* kernel = simd::get_kernel(isa);
+  constexpr size_t cache_line_floats = 16;
+  parallel_ranges(threads, front_x.size(), cache_line_floats, [&](size_t first, size_t last) {
+    kernel(s, first, last);
+  });
+}
+
+}  // namespace sim
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "math.hpp"
+#include "util/thread_pool.hpp"
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// A native implementation of the particle simulation in shader/particle.comp.
+// It must stay equivalent to the shader: it serves both as a backend for machines
+// where compute shaders are slow (or emulated), and as a reference for the shader
+namespace sim {
+
+using Resolution = glm::vec<2, unsigned>;
+
+// Defined as MAX_VELOCITY for shader/field.glsl
+constexpr float max_velocity = 5;
+
+// Velocities are in grid units per tick at this rate. At other tick rates, particles
+// move by `velocity * time_step` per tick, with `time_step = reference_tick_rate / rate`
+constexpr float reference_tick_rate = 60;
+
+// Matches the layout of `Particle` in the shader. All backends start with every particle
+// at zero (both ends), where it stays until its first respawn
+struct Particle {
+  vec2 front, back;
+};
+
+// Things that act upon the field: vortices (clockwise with force<0)
+// and pushers (pullers when force<0)
+struct Actor {
+  vec2 position;
+  float force;
+};
+
+// How particles follow the field through a tick. The field does not change within a tick
+// (actors only move between ticks), and the tick's time step is split into `substeps`
+// equal steps of the integrator, all within the one pass over the particles
+enum class Integrator {
+  euler,  // forward Euler, 1 field evaluation per substep
+  rk2,  // midpoint method, 2 evaluations
+  rk4,  // classic Runge-Kutta, 4 evaluations
+};
+
+std::string_view get_integrator_name(Integrator);
+unsigned get_field_evaluations(Integrator);
+
+struct Step_params {
+  unsigned tick;
+  unsigned particle_lifetime;
+  float time_step;
+  std::span<const Actor> vortices;
+  std::span<const Actor> pushers;
+  Integrator integrator = Integrator::euler;
+  unsigned substeps = 1;
+};
+
+vec2 velocity_at(vec2 p, const Step_params&);
+
+// Where a particle at `p` is one tick later. The order of floating-point operations
+// is the reference for all backends
+vec2 advance(vec2 p, const Step_params&);
+
+// How far the velocity field baked into a texture by shader/field_bake.comp
+// (velocity at texel centers, sampled bilinearly, clamped to edge) is from `velocity_at`.
+// Errors are magnitudes of the velocity difference, in grid units per tick
+struct Field_error {
+  double mean;
+  double p99;
+  double max;
+  size_t num_samples;
+};
+
+Field_error measure_baked_field_error(
+  std::span<const vec2> texels,
+  Resolution bake_size,
+  Resolution grid_size,
+  const Step_params&
+);
+
+// The actors of the scene at a given tick, as seen by all backends
+struct Scene {
+  std::vector<Actor> vortices;
+  std::vector<Actor> pushers;
+
+  // 0 for just the demo actors. Otherwise, exactly this many actors: the demo ones first
+  // (as many as fit), then deterministic pseudo-random ones to fill the rest
+  unsigned num_actors = 0;
+
+  // Ticks per second of scene time, which actors move in
+  float tick_rate = reference_tick_rate;
+
+  Integrator integrator = Integrator::euler;
+  unsigned substeps = 1;
+
+  void update(unsigned tick, Resolution grid_size);
+
+  [[nodiscard]] Step_params get_step_params(unsigned tick, unsigned particle_lifetime) const {
+    return {
+      .tick = tick,
+      .particle_lifetime = particle_lifetime,
+      .time_step = reference_tick_rate / tick_rate,
+      .vortices = vortices,
+      .pushers = pushers,
+      .integrator = integrator,
+      .substeps = substeps,
+    };
+  }
+};
+
+// Pseudo-random phase of each particle's respawn, matches the shader
+inline uint32_t particle_hash(uint32_t id) {
+  uint32_t random = 1664525u * id + 1013904223u;
+  random ^= (random << 13);
+  random ^= (random >> 17);
+  random ^= (random << 5);
+  return random;
+}
+
+// Particles are laid out row by row, and respawn at their place in the grid
+inline vec2 spawn_position(uint32_t id, Resolution grid_size) {
+  return {id % grid_size.x, id / grid_size.x};
+}
+
+// Straightforward port of the shader, particles stored as in the GPU buffer
+class Cpu_simulation {
+  Resolution grid_size;
+  Thread_pool threads;
+
+public:
+  // 0 threads means all hardware threads
+  explicit Cpu_simulation(Resolution grid_size, unsigned num_threads = 0);
+
+  // Advance one tick, single-threaded, for particles [first, first + particles.size())
+  void step_range(std::span<Particle> particles, unsigned first, const Step_params&) const;
+
+  // Advance one tick, spreading the particles across all threads
+  void step(std::span<Particle> particles, const Step_params&);
+
+  [[nodiscard]] unsigned get_num_threads() const {
+    return threads.size();
+  }
+};
+
+// ================================ Vectorized backend ================================
+
+// Instruction sets that the vectorized kernel is built for, picked at runtime
+enum class Isa { scalar, sse4_2, avx2, avx512 };
+
+std::string_view get_isa_name(Isa);
+bool is_isa_supported(Isa);
+Isa detect_best_isa();
+
+// Same simulation, but with particles stored as a structure of arrays and stepped
+// 4, 8 or 16 at a time. Results are bitwise identical to `Cpu_simulation`
+// (except for which NaN a particle sitting exactly on an actor gets).
+//
+// Only front positions are state (the back position is the front from the tick before),
+// so only they are kept as SoA. Each step also writes the particles interleaved
+// as the GPU expects them, for drawing.
+class Simd_simulation {
+  Resolution grid_size;
+  Isa isa;
+  Thread_pool threads;
+
+  std::vector<float> front_x;
+  std::vector<float> front_y;
+
+  // The respawn condition `(tick - hash) % lifetime == 0` has no vector instruction
+  // for the modulo, but since only `tick` changes, it can be decided by comparing
+  // per-particle `hash % lifetime` against a per-tick value, see `sim_simd.hpp`
+  std::vector<uint32_t> hash;
+  std::vector<uint32_t> hash_phase;
+  unsigned phase_lifetime = 0;
+
+public:
+  explicit Simd_simulation(Resolution grid_size, Isa isa = detect_best_isa(), unsigned num_threads = 0);
+
+  void step(const Step_params&, std::span<Particle> out);
+
+  // Continue from these particles instead of the state of the latest `step`
+  void set_particles(std::span<const Particle>);
+
+  [[nodiscard]] Isa get_isa() const {
+    return isa;
+  }
+
+  [[nodiscard]] unsigned get_num_threads() const {
+    return threads.size();
+  }
+};
+}  // namespace sim
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "sim.hpp"
+
+// Internals of `sim::Simd_simulation`: one kernel per instruction set, each in its own
+// translation unit compiled for that instruction set (see CMakeLists), so that one binary
+// runs everywhere and picks the widest kernel the CPU supports.
+//
+// All kernels must produce the same bits as `Cpu_simulation`, in particular:
+//  - same order of floating-point operations, and no FMA contraction
+//  - the respawn condition of the shader, `(tick - hash) % lifetime == 0` in uint32, is
+//    evaluated without a vector modulo. With `hash_phase = hash % lifetime` precomputed,
+//    it is `hash_phase == tick % lifetime` when `tick >= hash`, and otherwise
+//    (when `tick - hash` wraps around) `hash_phase == (tick + 2^32) % lifetime`
+//
+// Any function with external linkage that an ISA translation unit emits may be picked by
+// the linker for callers everywhere, so those units define nothing but their entry point:
+// the shared kernel has internal linkage (sim_simd_kernel.hpp), and it calls no inline
+// functions from other headers, not even for vectors or spans
+namespace sim::simd {
+
+struct Soa_step {
+  float* front_x;
+  float* front_y;
+  const uint32_t* hash;
+  const uint32_t* hash_phase;
+  Particle* out;
+
+  uint32_t tick;
+  uint32_t tick_phase;
+  uint32_t wrapped_tick_phase;
+  float time_step;
+
+  const Actor* vortices;
+  size_t num_vortices;
+  const Actor* pushers;
+  size_t num_pushers;
+  Integrator integrator;
+  unsigned substeps;
+
+  Resolution grid_size;
+};
+
+// Step particles [first, last)
+using Step_kernel = void(const Soa_step&, size_t first, size_t last);
+
+// Plain C++, defined in sim.cpp. Also handles the tails that do not fill a whole vector
+// in the other kernels
+Step_kernel step_scalar;
+
+Step_kernel step_sse4_2;
+Step_kernel step_avx2;
+Step_kernel step_avx512;
+
+Step_kernel* get_kernel(Isa);
+}  // namespace sim::simd
@@ -0,0 +1,83 @@
+#include "sim_simd_kernel.hpp"
+
+namespace sim::simd {
+namespace {
+struct Avx2 {
+  using Float = __m256;
+  using Int = __m256i;
+  constexpr static size_t width = 8;
+
+  static Float set1(float x) {
+    return _mm256_set1_ps(x);
+  }
+
+  static Int set1(uint32_t x) {
+    return _mm256_set1_epi32(static_cast<int>(x));
+  }
+
+  static Float load(const float* p) {
+    return _mm256_loadu_ps(p);
+  }
+
+  static Int load(const uint32_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  }
+
+  static void store(float* p, Float x) {
+    _mm256_storeu_ps(p, x);
+  }
+
+  static Float add(Float a, Float b) {
+    return _mm256_add_ps(a, b);
+  }
+
+  static Float sub(Float a, Float b) {
+    return _mm256_sub_ps(a, b);
+  }
+
+  static Float mul(Float a, Float b) {
+    return _mm256_mul_ps(a, b);
+  }
+
+  static Float div(Float a, Float b) {
+    return _mm256_div_ps(a, b);
+  }
+
+  static Float sqrt(Float a) {
+    return _mm256_sqrt_ps(a);
+  }
+
+  static Float neg(Float a) {
+    return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f));
+  }
+
+  static Float greater(Float a, Float b) {
+    return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+  }
+
+  static Float select(Float mask, Float a, Float b) {
+    return _mm256_blendv_ps(b, a, mask);
+  }
+
+  static Int equal(Int a, Int b) {
+    return _mm256_cmpeq_epi32(a, b);
+  }
+
+  static Int greater_equal_unsigned(Int a, Int b) {
+    return _mm256_cmpeq_epi32(_mm256_max_epu32(a, b), a);
+  }
+
+  static Int select(Int mask, Int a, Int b) {
+    return _mm256_blendv_epi8(b, a, mask);
+  }
+
+  static unsigned bits(Int mask) {
+    return _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+  }
+};
+}  // namespace
+
+void step_avx2(const Soa_step& s, size_t first, size_t last) {
+  step_vectorized<Avx2>(s, first, last);
+}
+}  // namespace sim::simd
@@ -0,0 +1,88 @@
+#include "sim_simd_kernel.hpp"
+
+// GCC 12 warns about the deliberately undefined passthrough operand inside
+// the AVX-512 intrinsics themselves
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+namespace sim::simd {
+namespace {
+struct Avx512 {
+  using Float = __m512;
+  using Int = __m512i;
+  constexpr static size_t width = 16;
+
+  static Float set1(float x) {
+    return _mm512_set1_ps(x);
+  }
+
+  static Int set1(uint32_t x) {
+    return _mm512_set1_epi32(static_cast<int>(x));
+  }
+
+  static Float load(const float* p) {
+    return _mm512_loadu_ps(p);
+  }
+
+  static Int load(const uint32_t* p) {
+    return _mm512_loadu_si512(p);
+  }
+
+  static void store(float* p, Float x) {
+    _mm512_storeu_ps(p, x);
+  }
+
+  static Float add(Float a, Float b) {
+    return _mm512_add_ps(a, b);
+  }
+
+  static Float sub(Float a, Float b) {
+    return _mm512_sub_ps(a, b);
+  }
+
+  static Float mul(Float a, Float b) {
+    return _mm512_mul_ps(a, b);
+  }
+
+  static Float div(Float a, Float b) {
+    return _mm512_div_ps(a, b);
+  }
+
+  static Float sqrt(Float a) {
+    return _mm512_sqrt_ps(a);
+  }
+
+  static Float neg(Float a) {
+    const __m512i sign = _mm512_set1_epi32(0x80000000);
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), sign));
+  }
+
+  static __mmask16 greater(Float a, Float b) {
+    return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+  }
+
+  static Float select(__mmask16 mask, Float a, Float b) {
+    return _mm512_mask_blend_ps(mask, b, a);
+  }
+
+  static __mmask16 equal(Int a, Int b) {
+    return _mm512_cmpeq_epi32_mask(a, b);
+  }
+
+  static __mmask16 greater_equal_unsigned(Int a, Int b) {
+    return _mm512_cmpge_epu32_mask(a, b);
+  }
+
+  static Int select(__mmask16 mask, Int a, Int b) {
+    return _mm512_mask_blend_epi32(mask, b, a);
+  }
+
+  static unsigned bits(__mmask16 mask) {
+    return mask;
+  }
+};
+}  // namespace
+
+void step_avx512(const Soa_step& s, size_t first, size_t last) {
+  step_vectorized<Avx512>(s, first, last);
+}
+}  // namespace sim::simd
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "sim_simd.hpp"
+#include <immintrin.h>
+
+// The vectorized kernel, written once against a small set of operations `V`
+// that each of the sim_simd_*.cpp files provides for its instruction set.
+// Unnamed namespace: each ISA translation unit gets its own copy (see sim_simd.hpp)
+namespace sim::simd {
+namespace {
+
+template<typename V>
+void step_vectorized(const Soa_step& s, size_t first, size_t last) {
+  using F = typename V::Float;
+  using I = typename V::Int;
+  constexpr size_t width = V::width;
+
+  const I tick = V::set1(s.tick);
+  const I tick_phase = V::set1(s.tick_phase);
+  const I wrapped_tick_phase = V::set1(s.wrapped_tick_phase);
+  const F max_velocity_v = V::set1(max_velocity);
+  const F max_velocity2_v = V::set1(max_velocity * max_velocity);
+  const F zero = V::set1(0.0f);
+  const F two = V::set1(2.0f);
+
+  // The step of each substep, computed as in `sim::advance`
+  const float substep_length = s.time_step / s.substeps;
+  const F h = V::set1(substep_length);
+  const F half_h = V::set1(substep_length * 0.5f);
+  const F sixth_h = V::set1(substep_length / 6);
+
+  struct Velocity {
+    F x, y;
+  };
+  const auto velocity_at = [&](F x, F y) {
+    F vel_x = zero;
+    F vel_y = zero;
+    for (const Actor* v = s.vortices; v != s.vortices + s.num_vortices; v++) {
+      const F force = V::set1(v->force);
+      const F rx = V::sub(x, V::set1(v->position.x));
+      const F ry = V::sub(y, V::set1(v->position.y));
+      const F r2 = V::add(V::mul(rx, rx), V::mul(ry, ry));
+      vel_x = V::add(vel_x, V::div(V::mul(force, V::neg(ry)), r2));
+      vel_y = V::add(vel_y, V::div(V::mul(force, rx), r2));
+    }
+    for (const Actor* p = s.pushers; p != s.pushers + s.num_pushers; p++) {
+      const F force = V::set1(p->force);
+      const F rx = V::sub(x, V::set1(p->position.x));
+      const F ry = V::sub(y, V::set1(p->position.y));
+      const F r2 = V::add(V::mul(rx, rx), V::mul(ry, ry));
+      vel_x = V::add(vel_x, V::div(V::mul(force, rx), r2));
+      vel_y = V::add(vel_y, V::div(V::mul(force, ry), r2));
+    }
+
+    const F vel2 = V::add(V::mul(vel_x, vel_x), V::mul(vel_y, vel_y));
+    const auto too_fast = V::greater(vel2, max_velocity2_v);
+    const F scale = V::div(max_velocity_v, V::sqrt(vel2));
+    return Velocity{
+      V::select(too_fast, V::mul(vel_x, scale), vel_x),
+      V::select(too_fast, V::mul(vel_y, scale), vel_y),
+    };
+  };
+
+  size_t i = first;
+  for (; i + width <= last; i += width) {
+    {  // Respawn: rare, so patch the state in memory lane by lane before loading it
+      const I hash = V::load(s.hash + i);
+      const I phase = V::select(V::greater_equal_unsigned(tick, hash), tick_phase, wrapped_tick_phase);
+      unsigned lanes = V::bits(V::equal(V::load(s.hash_phase + i), phase));
+      for (; lanes != 0; lanes &= lanes - 1) {
+        // As `sim::spawn_position`
+        uint32_t id = i + __builtin_ctz(lanes);
+        s.front_x[id] = id % s.grid_size.x;
+        s.front_y[id] = id / s.grid_size.x;
+      }
+    }
+
+    const F old_x = V::load(s.front_x + i);
+    const F old_y = V::load(s.front_y + i);
+
+    // Same operations as `sim::advance`, on a vector of positions
+    F new_x = old_x;
+    F new_y = old_y;
+    for (unsigned substep = 0; substep < s.substeps; substep++) {
+      switch (s.integrator) {
+      case Integrator::euler: {
+        const Velocity k1 = velocity_at(new_x, new_y);
+        new_x = V::add(new_x, V::mul(k1.x, h));
+        new_y = V::add(new_y, V::mul(k1.y, h));
+        break;
+      }
+      case Integrator::rk2: {
+        const Velocity k1 = velocity_at(new_x, new_y);
+        const Velocity k2 =
+          velocity_at(V::add(new_x, V::mul(k1.x, half_h)), V::add(new_y, V::mul(k1.y, half_h)));
+        new_x = V::add(new_x, V::mul(k2.x, h));
+        new_y = V::add(new_y, V::mul(k2.y, h));
+        break;
+      }
+      case Integrator::rk4: {
+        const Velocity k1 = velocity_at(new_x, new_y);
+        const Velocity k2 =
+          velocity_at(V::add(new_x, V::mul(k1.x, half_h)), V::add(new_y, V::mul(k1.y, half_h)));
+        const Velocity k3 =
+          velocity_at(V::add(new_x, V::mul(k2.x, half_h)), V::add(new_y, V::mul(k2.y, half_h)));
+        const Velocity k4 = velocity_at(V::add(new_x, V::mul(k3.x, h)), V::add(new_y, V::mul(k3.y, h)));
+        const auto weighted_sum = [&](F a, F b, F c, F d) {
+          return V::add(V::add(V::add(a, V::mul(b, two)), V::mul(c, two)), d);
+        };
+        new_x = V::add(new_x, V::mul(weighted_sum(k1.x, k2.x, k3.x, k4.x), sixth_h));
+        new_y = V::add(new_y, V::mul(weighted_sum(k1.y, k2.y, k3.y, k4.y), sixth_h));
+        break;
+      }
+      }
+    }
+    V::store(s.front_x + i, new_x);
+    V::store(s.front_y + i, new_y);
+
+    // Interleave for the GPU
+    alignas(64) float lanes[4][width];
+    V::store(lanes[0], new_x);
+    V::store(lanes[1], new_y);
+    V::store(lanes[2], old_x);
+    V::store(lanes[3], old_y);
+    for (size_t l = 0; l < width; l++) {
+      Particle& out = s.out[i + l];
+      out.front.x = lanes[0][l];
+      out.front.y = lanes[1][l];
+      out.back.x = lanes[2][l];
+      out.back.y = lanes[3][l];
+    }
+  }
+
+  step_scalar(s, i, last);
+}
+}  // namespace
+}  // namespace sim::simd
@@ -0,0 +1,83 @@
+#include "sim_simd_kernel.hpp"
+
+namespace sim::simd {
+namespace {
+struct Sse4_2 {
+  using Float = __m128;
+  using Int = __m128i;
+  constexpr static size_t width = 4;
+
+  static Float set1(float x) {
+    return _mm_set1_ps(x);
+  }
+
+  static Int set1(uint32_t x) {
+    return _mm_set1_epi32(static_cast<int>(x));
+  }
+
+  static Float load(const float* p) {
+    return _mm_loadu_ps(p);
+  }
+
+  static Int load(const uint32_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  }
+
+  static void store(float* p, Float x) {
+    _mm_storeu_ps(p, x);
+  }
+
+  static Float add(Float a, Float b) {
+    return _mm_add_ps(a, b);
+  }
+
+  static Float sub(Float a, Float b) {
+    return _mm_sub_ps(a, b);
+  }
+
+  static Float mul(Float a, Float b) {
+    return _mm_mul_ps(a, b);
+  }
+
+  static Float div(Float a, Float b) {
+    return _mm_div_ps(a, b);
+  }
+
+  static Float sqrt(Float a) {
+    return _mm_sqrt_ps(a);
+  }
+
+  static Float neg(Float a) {
+    return _mm_xor_ps(a, _mm_set1_ps(-0.0f));
+  }
+
+  static Float greater(Float a, Float b) {
+    return _mm_cmpgt_ps(a, b);
+  }
+
+  static Float select(Float mask, Float a, Float b) {
+    return _mm_blendv_ps(b, a, mask);
+  }
+
+  static Int equal(Int a, Int b) {
+    return _mm_cmpeq_epi32(a, b);
+  }
+
+  static Int greater_equal_unsigned(Int a, Int b) {
+    return _mm_cmpeq_epi32(_mm_max_epu32(a, b), a);
+  }
+
+  static Int select(Int mask, Int a, Int b) {
+    return _mm_blendv_epi8(b, a, mask);
+  }
+
+  static unsigned bits(Int mask) {
+    return _mm_movemask_ps(_mm_castsi128_ps(mask));
+  }
+};
+}  // namespace
+
+void step_sse4_2(const Soa_step& s, size_t first, size_t last) {
+  step_vectorized<Sse4_2>(s, first, last);
+}
+}  // namespace sim::simd
@@ -0,0 +1,212 @@
+#include "snapshot.hpp"
+#include "util/util.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace snapshot {
+namespace {
+struct Header {
+  constexpr static char expected_magic[8] = {'f', 's', 'i', 'm', 's', 'n', 'a', 'p'};
+  constexpr static uint32_t expected_version = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  uint32_t grid_x, grid_y;
+  uint32_t tick;
+  uint32_t particle_lifetime;
+  uint32_t tick_rate;
+  uint32_t num_actors;
+
+  uint64_t particles_offset;
+  uint64_t num_particles;
+  uint64_t actors_offset;
+  uint32_t num_vortices;
+  uint32_t num_pushers;
+};
+
+constexpr uint64_t particles_offset = (sizeof(Header) + 63) / 64 * 64;
+
+Header make_header(const State& state, uint64_t num_particles) {
+  Header h;
+  std::memcpy(h.magic, h.expected_magic, sizeof(h.magic));
+  h.version = h.expected_version;
+  h.header_size = sizeof(Header);
+  h.grid_x = state.grid_size.x;
+  h.grid_y = state.grid_size.y;
+  h.tick = state.tick;
+  h.particle_lifetime = state.particle_lifetime;
+  h.tick_rate = state.tick_rate;
+  h.num_actors = state.num_actors;
+  h.particles_offset = particles_offset;
+  h.num_particles = num_particles;
+  h.actors_offset = particles_offset + sizeof(sim::Particle) * num_particles;
+  h.num_vortices = state.vortices.size();
+  h.num_pushers = state.pushers.size();
+  return h;
+}
+}  // namespace
+
+// ================================== Reading ==================================
+
+Mapped_snapshot::Mapped_snapshot(std::string_view path_view) {
+  const std::string path{path_view};
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    FATAL("Cannot open snapshot '{}': {}", path, std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+    FATAL("Snapshot '{}' is too short to be one", path);
+  }
+  mapping_size = st.st_size;
+  mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    FATAL("Cannot map snapshot '{}': {}", path, std::strerror(errno));
+  }
+
+  const auto* bytes = static_cast<const std::byte*>(mapping);
+  Header h;
+  std::memcpy(&h, bytes, sizeof(h));
+  if (std::memcmp(h.magic, h.expected_magic, sizeof(h.magic)) != 0) {
+    FATAL("'{}' is not a snapshot", path);
+  }
+  if (h.version != h.expected_version || h.header_size != sizeof(Header)) {
+    FATAL("Snapshot '{}' is version {}, only version {} is supported", path, h.version, h.expected_version);
+  }
+
+  const uint64_t actors_size = sizeof(sim::Actor) * (uint64_t{h.num_vortices} + h.num_pushers);
+  if (h.num_particles != uint64_t{h.grid_x} * h.grid_y
+      || h.particles_offset % alignof(sim::Particle) != 0
+      || h.actors_offset % alignof(sim::Actor) != 0
+      || h.particles_offset + sizeof(sim::Particle) * h.num_particles > mapping_size
+      || h.actors_offset + actors_size > mapping_size) {
+    FATAL("Snapshot '{}' is corrupt or truncated", path);
+  }
+
+  const auto* actors = reinterpret_cast<const sim::Actor*>(bytes + h.actors_offset);
+  state = {
+    .grid_size = {h.grid_x, h.grid_y},
+    .tick = h.tick,
+    .particle_lifetime = h.particle_lifetime,
+    .tick_rate = h.tick_rate,
+    .num_actors = h.num_actors,
+    .particles = {reinterpret_cast<const sim::Particle*>(bytes + h.particles_offset), h.num_particles},
+    .vortices = {actors, h.num_vortices},
+    .pushers = {actors + h.num_vortices, h.num_pushers},
+  };
+}
+
+Mapped_snapshot::~Mapped_snapshot() {
+  munmap(mapping, mapping_size);
+}
+
+// ================================== Writing ==================================
+
+bool write_file(std::string_view path_view, const State& state) {
+  const std::string path{path_view};
+  const std::string temp_path = path + ".tmp";
+  std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    WARNING("Cannot write snapshot '{}': {}", temp_path, std::strerror(errno));
+    return false;
+  }
+
+  const Header h = make_header(state, state.particles.size());
+  const char padding[particles_offset - sizeof(Header)] = {};
+  std::fwrite(&h, sizeof(h), 1, file);
+  std::fwrite(padding, sizeof(padding), 1, file);
+  std::fwrite(state.particles.data(), sizeof(sim::Particle), state.particles.size(), file);
+  std::fwrite(state.vortices.data(), sizeof(sim::Actor), state.vortices.size(), file);
+  std::fwrite(state.pushers.data(), sizeof(sim::Actor), state.pushers.size(), file);
+
+  const bool ok = !std::ferror(file);
+  if (std::fclose(file) != 0 || !ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    WARNING("Cannot write snapshot '{}': {}", path, std::strerror(errno));
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+Async_writer::~Async_writer() {
+  finish();
+}
+
+void Async_writer::start(std::string_view path_, const gl::Buffer& particles, const State& state_) {
+  if (stage != Stage::idle) {
+    WARNING("Snapshot to '{}' is still in progress, not starting another one", path);
+    return;
+  }
+
+  path = path_;
+  state = state_;
+  vortices.assign(state.vortices.begin(), state.vortices.end());
+  pushers.assign(state.pushers.begin(), state.pushers.end());
+  state.vortices = vortices;
+  state.pushers = pushers;
+
+  const size_t size = sizeof(sim::Particle) * state.grid_size.x * state.grid_size.y;
+  readback = gl::Buffer::create();
+  glNamedBufferStorage(readback.get(), size, nullptr, GL_MAP_READ_BIT);
+  // The particles may have just been written by the compute shader as storage
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glCopyNamedBufferSubData(particles.get(), readback.get(), 0, 0, size);
+  fence = gl::Sync::fence();
+  stage = Stage::copying;
+}
+
+void Async_writer::poll() {
+  if (stage == Stage::copying) {
+    if (glClientWaitSync(fence.get(), GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+      return;
+    }
+    begin_writing();
+  }
+  if (stage == Stage::writing && written) {
+    end_writing();
+  }
+}
+
+void Async_writer::finish() {
+  if (stage == Stage::copying) {
+    glClientWaitSync(fence.get(), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    begin_writing();
+  }
+  if (stage == Stage::writing) {
+    end_writing();
+  }
+}
+
+void Async_writer::begin_writing() {
+  fence.reset();
+  const size_t num_particles = size_t{state.grid_size.x} * state.grid_size.y;
+  const size_t size = sizeof(sim::Particle) * num_particles;
+  const auto* particles = gl::map_buffer_range_as<sim::Particle>(readback, 0, size, GL_MAP_READ_BIT);
+  state.particles = {particles, num_particles};
+
+  written = false;
+  writer = std::thread([this] {
+    if (write_file(path, state)) {
+      INFO("Wrote snapshot of tick {} to '{}'", state.tick, path);
+    }
+    written = true;
+  });
+  stage = Stage::writing;
+}
+
+void Async_writer::end_writing() {
+  writer.join();
+  gl::unmap_buffer(readback);
+  readback.reset();
+  stage = Stage::idle;
+}
+
+}  // namespace snapshot
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "gl.hpp"
+#include "sim.hpp"
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Snapshots of the simulation, to resume a run where it left off instead of warming
+// it up from the seed positions again.
+//
+// A snapshot file is a fixed header, followed by the particles exactly as they are laid
+// out in the GPU buffer, followed by the actors (vortices, then pushers). Offsets in the
+// header are in bytes from the start of the file, and aligned for the data there,
+// so that a file mapped into memory can be used as is. All numbers are little-endian
+namespace snapshot {
+
+using sim::Resolution;
+
+struct State {
+  Resolution grid_size;
+  uint32_t tick;  // the next tick to run
+  uint32_t particle_lifetime;  // in ticks at `tick_rate`
+  uint32_t tick_rate;
+  uint32_t num_actors;  // see `sim::Scene::num_actors`
+  std::span<const sim::Particle> particles;
+  std::span<const sim::Actor> vortices;
+  std::span<const sim::Actor> pushers;
+};
+
+// A snapshot file mapped read-only. Dies if the file is not a valid snapshot
+class Mapped_snapshot {
+  void* mapping = nullptr;
+  size_t mapping_size = 0;
+  State state;
+
+public:
+  explicit Mapped_snapshot(std::string_view path);
+  ~Mapped_snapshot();
+
+  Mapped_snapshot(const Mapped_snapshot&) = delete;
+  Mapped_snapshot& operator=(const Mapped_snapshot&) = delete;
+
+  [[nodiscard]] const State& get() const {
+    return state;
+  }
+};
+
+// Writes a snapshot without stalling rendering: the particles are copied on the GPU
+// into a readback buffer, which gets mapped once its fence signals (some frames later),
+// and a thread writes the file straight out of the mapping.
+// Only one snapshot is in progress at a time
+class Async_writer {
+public:
+  ~Async_writer();
+
+  // `state.particles` is ignored in favor of the contents of `particles`
+  void start(std::string_view path, const gl::Buffer& particles, const State& state);
+
+  // Advance the snapshot in progress, if any, without blocking. Call every frame
+  void poll();
+
+  // Block until the snapshot in progress, if any, is written
+  void finish();
+
+private:
+  enum class Stage { idle, copying, writing };
+  Stage stage = Stage::idle;
+
+  std::string path;
+  State state;
+  std::vector<sim::Actor> vortices;
+  std::vector<sim::Actor> pushers;
+  gl::Buffer readback;
+  gl::Sync fence;
+  std::thread writer;
+  std::atomic<bool> written = false;
+
+  void begin_writing();
+  void end_writing();
+};
+
+// Write the file in one go, through a temporary so that no one sees half a snapshot.
+// Returns whether it succeeded
+bool write_file(std::string_view path, const State&);
+
+}  // namespace snapshot
@@ -0,0 +1,140 @@
+#include "trace.hpp"
+#include "gl.hpp"
+#include "util/util.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+namespace {
+struct Zone {
+  std::string_view name;
+  int64_t begin_ns, end_ns;  // since `start_time`
+};
+
+// Appended to by one thread only, and read by `finish` once that thread is done recording
+struct Thread_buffer {
+  std::string name;
+  std::vector<Zone> zones;
+};
+
+std::string path;
+Clock::time_point start_time;
+int64_t gpu_clock_offset_ns = 0;  // from GL_TIMESTAMP to nanoseconds since `start_time`
+
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<Thread_buffer>> buffers;  // owned here, to outlive their threads
+Thread_buffer* gpu_buffer = nullptr;
+
+int64_t get_ns_since_start(Clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t - start_time).count();
+}
+
+// Unnamed buffers get named after their index
+Thread_buffer& add_buffer(std::string_view name) {
+  std::lock_guard lock(buffers_mutex);
+  auto& buffer = buffers.emplace_back(std::make_unique<Thread_buffer>());
+  buffer->name = name.empty() ? fmt::format(FMT_STRING("thread {}"), buffers.size() - 1) : std::string(name);
+  return *buffer;
+}
+
+Thread_buffer& get_thread_buffer() {
+  thread_local Thread_buffer* buffer = nullptr;
+  if (!buffer) {
+    buffer = &add_buffer({});
+  }
+  return *buffer;
+}
+
+void write_zones(std::FILE* file, const Thread_buffer& buffer, size_t tid) {
+  fmt::print(
+    file,
+    FMT_STRING("\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+               "\"args\":{{\"name\":\"{}\"}}}}"),
+    tid,
+    buffer.name
+  );
+  for (const Zone& zone: buffer.zones) {
+    fmt::print(
+      file,
+      FMT_STRING(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}"),
+      zone.name,
+      tid,
+      zone.begin_ns * 1e-3,
+      (zone.end_ns - zone.begin_ns) * 1e-3
+    );
+  }
+}
+}  // namespace
+
+void detail::add_zone(std::string_view name, Clock::time_point begin, Clock::time_point end) {
+  // A zone that began before `finish` may end after it
+  if (!is_enabled()) {
+    return;
+  }
+  get_thread_buffer().zones.push_back({name, get_ns_since_start(begin), get_ns_since_start(end)});
+}
+
+void start(std::string_view path_) {
+  path = path_;
+  start_time = Clock::now();
+  get_thread_buffer().name = "main";
+  gpu_buffer = &add_buffer("GPU");
+  detail::is_recording.store(true, std::memory_order_relaxed);
+  INFO("Recording a trace to '{}'", path);
+}
+
+void calibrate_gpu_clock() {
+  GLint64 gpu_ns;
+  glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+  gpu_clock_offset_ns = get_ns_since_start(Clock::now()) - gpu_ns;
+}
+
+void add_gpu_zone(std::string_view name, uint64_t begin_ns, uint64_t end_ns) {
+  if (!is_enabled()) {
+    return;
+  }
+  gpu_buffer->zones.push_back({
+    name,
+    int64_t(begin_ns) + gpu_clock_offset_ns,
+    int64_t(end_ns) + gpu_clock_offset_ns,
+  });
+}
+
+void finish() {
+  if (!is_enabled()) {
+    return;
+  }
+  detail::is_recording.store(false, std::memory_order_relaxed);
+
+  std::FILE* file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    WARNING("Cannot write trace to '{}': {}", path, std::strerror(errno));
+    return;
+  }
+
+  std::lock_guard lock(buffers_mutex);
+  size_t num_zones = 0;
+  std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+  for (size_t i = 0; i < buffers.size(); i++) {
+    if (i > 0) {
+      std::fputc(',', file);
+    }
+    write_zones(file, *buffers[i], i);
+    num_zones += buffers[i]->zones.size();
+    buffers[i]->zones.clear();
+  }
+  std::fputs("\n]}\n", file);
+
+  const bool ok = !std::ferror(file);
+  if (std::fclose(file) != 0 || !ok) {
+    WARNING("Cannot write trace to '{}': {}", path, std::strerror(errno));
+  } else {
+    INFO("Wrote {} zones to '{}'", num_zones, path);
+  }
+}
+}  // namespace trace
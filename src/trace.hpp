@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// Recording of timed zones of CPU work and GPU passes, written out in the Chrome trace
+// event format, which chrome://tracing and ui.perfetto.dev open as a timeline.
+//
+// Each thread appends its zones to a buffer of its own, so recording takes no locks
+// (only the first zone of a thread does, to register the buffer). Zone names are
+// not copied, and must outlive the trace: string literals, in practice.
+// With tracing off, a zone costs a relaxed atomic load and a branch.
+//
+// GPU zones come from timestamp queries (see `gl::Gpu_timer`), and are placed on the CPU
+// timeline by an offset between the clocks taken with `calibrate_gpu_clock`
+namespace trace {
+using Clock = std::chrono::steady_clock;
+
+namespace detail {
+inline std::atomic<bool> is_recording = false;
+void add_zone(std::string_view name, Clock::time_point begin, Clock::time_point end);
+}  // namespace detail
+
+[[nodiscard]] inline bool is_enabled() {
+  return detail::is_recording.load(std::memory_order_relaxed);
+}
+
+// Start recording, to write the trace to `path` at `finish`.
+// The calling thread is listed first in the trace, as the main thread
+void start(std::string_view path);
+
+// Stop recording and write the trace. No other thread may be recording at the time
+void finish();
+
+// Match the GL_TIMESTAMP clock to the CPU one. Needs a current GL context
+void calibrate_gpu_clock();
+
+// Times from GL_TIMESTAMP queries, in nanoseconds. Only from the thread with the context
+void add_gpu_zone(std::string_view name, uint64_t begin_ns, uint64_t end_ns);
+
+// Records the time from construction to destruction as a zone of the current thread
+class Scope {
+  std::string_view name;
+  Clock::time_point begin;
+  bool is_recorded;
+
+public:
+  explicit Scope(std::string_view name_) : name{name_}, is_recorded{is_enabled()} {
+    if (is_recorded) {
+      begin = Clock::now();
+    }
+  }
+
+  ~Scope() {
+    if (is_recorded) {
+      detail::add_zone(name, begin, Clock::now());
+    }
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+};
+}  // namespace trace
+
+#define TRACE_CONCAT_IMPL(A, B) A##B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_IMPL(A, B)
+#define TRACE_SCOPE(NAME) ::trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(NAME)
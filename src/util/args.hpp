@@ -0,0 +1,42 @@
+#pragma once
+
+#include <charconv>
+#include <string_view>
+
+// Parsing of command line option values, for options of the form `--name=value`
+namespace arg {
+using std::string_view;
+
+struct Arg_parse_exception {
+  string_view subject;
+  string_view defect;
+};
+
+void parse_number(string_view arg, auto& x) {
+  auto [ptr, ec] = std::from_chars(arg.begin(), arg.end(), x);
+  if (ec != std::errc{}) {
+    throw Arg_parse_exception{.subject = arg, .defect = "is not a number"};
+  }
+}
+
+void parse_resolution(string_view arg, auto& x, auto& y) {
+  size_t delim = arg.find('x');
+  if (delim == arg.npos) {
+    throw Arg_parse_exception{.subject = arg, .defect = "has no delimiter (e.g. 200x200)"};
+  }
+  parse_number(arg.substr(0, delim), x);
+  parse_number(arg.substr(delim + 1), y);
+}
+
+// Comma-separated values, each passed to `parse_item` as a string_view
+void parse_list(string_view arg, auto&& parse_item) {
+  while (true) {
+    size_t delim = arg.find(',');
+    parse_item(arg.substr(0, delim));
+    if (delim == arg.npos) {
+      break;
+    }
+    arg = arg.substr(delim + 1);
+  }
+}
+}  // namespace arg
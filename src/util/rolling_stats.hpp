@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+// Statistics over a sliding window of the latest `Window` samples.
+// Meant for per-frame measurements: adding a sample is O(1), querying a percentile
+// copies and partially sorts the window, so it should happen at a much lower rate
+template<size_t Window>
+class Rolling_stats {
+  std::array<double, Window> samples;
+  size_t num_samples = 0;
+  size_t next = 0;
+
+public:
+  void add(double x) {
+    samples[next] = x;
+    next = (next + 1) % Window;
+    num_samples = std::min(num_samples + 1, Window);
+  }
+
+  [[nodiscard]] size_t size() const {
+    return num_samples;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return num_samples == 0;
+  }
+
+  [[nodiscard]] double mean() const {
+    double sum = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+      sum += samples[i];
+    }
+    return empty() ? 0 : sum / num_samples;
+  }
+
+  // `p` in [0, 1], nearest-rank
+  [[nodiscard]] double percentile(double p) const {
+    if (empty()) {
+      return 0;
+    }
+    std::array<double, Window> sorted = samples;
+    auto rank = static_cast<size_t>(std::ceil(p * num_samples));
+    auto nth = sorted.begin() + std::clamp<size_t>(rank, 1, num_samples) - 1;
+    std::nth_element(sorted.begin(), nth, sorted.begin() + num_samples);
+    return *nth;
+  }
+};
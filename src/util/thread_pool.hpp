@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run one job at a time, fork-join style: `run(f)` calls
+// `f(i)` once for each i in [0, size()) across the workers and the calling thread,
+// and returns when all calls have returned. Meant for data-parallel loops executed
+// every frame, where spawning threads each time would cost too much
+class Thread_pool {
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable work_done;
+  const std::function<void(unsigned)>* job = nullptr;
+  unsigned long generation = 0;
+  unsigned num_busy = 0;
+  bool quitting = false;
+
+  void worker_loop(unsigned index) {
+    unsigned long seen_generation = 0;
+    while (true) {
+      const std::function<void(unsigned)>* current_job;
+      {
+        std::unique_lock lock(mutex);
+        work_available.wait(lock, [&] { return quitting || generation != seen_generation; });
+        if (quitting) {
+          return;
+        }
+        seen_generation = generation;
+        current_job = job;
+      }
+      (*current_job)(index);
+      {
+        std::lock_guard lock(mutex);
+        if (--num_busy == 0) {
+          work_done.notify_one();
+        }
+      }
+    }
+  }
+
+public:
+  // 0 threads means as many as there are hardware threads
+  explicit Thread_pool(unsigned num_threads = 0) {
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 1; i < num_threads; i++) {
+      workers.emplace_back(&Thread_pool::worker_loop, this, i);
+    }
+  }
+
+  ~Thread_pool() {
+    {
+      std::lock_guard lock(mutex);
+      quitting = true;
+    }
+    work_available.notify_all();
+    for (std::thread& t: workers) {
+      t.join();
+    }
+  }
+
+  Thread_pool(const Thread_pool&) = delete;
+  Thread_pool& operator=(const Thread_pool&) = delete;
+
+  [[nodiscard]] unsigned size() const {
+    return workers.size() + 1;
+  }
+
+  void run(const std::function<void(unsigned)>& f) {
+    {
+      std::lock_guard lock(mutex);
+      job = &f;
+      num_busy = workers.size();
+      generation++;
+    }
+    work_available.notify_all();
+    f(0);
+    std::unique_lock lock(mutex);
+    work_done.wait(lock, [&] { return num_busy == 0; });
+  }
+};
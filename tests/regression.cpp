@@ -0,0 +1,356 @@
+#include "gfx.hpp"
+#include "image.hpp"
+#include "sim.hpp"
+#include "snapshot.hpp"
+#include "util/args.hpp"
+#include "util/util.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Regression tests, run by ctest on Mesa's software rasterizer (see CMakeLists.txt).
+// Usage: regression_test [--update] [--golden-dir=DIR] [--baselines=FILE] [--max-slowdown=PERCENT] case...
+//
+// A golden case runs a fixed configuration headless for a fixed number of ticks, one per
+// frame, accumulating frames without clearing, and compares the accumulated image and
+// the particles of the last tick to those stored in the golden directory, within tolerances
+// that allow for a different rasterizer or compiler to round differently.
+// A performance case runs a larger configuration and fails when its ticks/s fall more
+// than `--max-slowdown` percent below the baseline in `--baselines`. Ticks/s only compare
+// on the same machine, so baselines are not stored with the goldens: the first run on
+// a machine (with no baseline for the case yet) records one and passes.
+//
+// With `--update`, the cases store what they get instead, as the new goldens or baselines.
+// Images are stored as PPM, particles as snapshots (see snapshot.hpp)
+
+namespace {
+using sim::Resolution;
+using Clock = std::chrono::steady_clock;
+
+struct Golden_case {
+  std::string_view name;
+  gfx::Sim_backend backend = gfx::Sim_backend::gl;
+  gfx::Renderer renderer = gfx::Renderer::lines;
+  sim::Integrator integrator = sim::Integrator::euler;
+  unsigned field_bake_size = 0;
+};
+
+constexpr Golden_case golden_cases[] = {
+  {.name = "gl_lines"},
+  {.name = "gl_splat", .renderer = gfx::Renderer::splat},
+  {.name = "gl_rk4_baked", .integrator = sim::Integrator::rk4, .field_bake_size = 64},
+  {.name = "cpu_simd_lines", .backend = gfx::Sim_backend::cpu_simd},
+};
+
+constexpr Resolution golden_screen_size = {128, 128};
+constexpr Resolution golden_grid_size = {64, 64};
+constexpr unsigned golden_num_ticks = 120;
+
+// Channels may be off by this much anywhere, and by any amount in a few pixels
+constexpr int pixel_tolerance = 8;
+constexpr double max_differing_pixels = 0.005;
+// Same for particles, in grid units
+constexpr float position_tolerance = 1e-2;
+constexpr double max_differing_particles = 0.005;
+
+constexpr std::string_view perf_case_name = "perf_gl";
+constexpr Resolution perf_screen_size = {256, 256};
+constexpr Resolution perf_grid_size = {256, 256};
+constexpr unsigned perf_num_ticks = 200;
+constexpr int perf_num_runs = 3;  // of which the fastest counts, to shrug off hiccups
+
+struct Test_config {
+  bool update = false;
+  std::filesystem::path golden_dir = "tests/golden";
+  std::filesystem::path baselines_path = "perf_baselines.txt";
+  double max_slowdown_percent = 20;
+};
+
+gfx::Config get_gfx_config(Resolution screen_size, Resolution grid_size) {
+  gfx::Config cfg;
+  cfg.headless = true;
+  cfg.screen_res_x = screen_size.x;
+  cfg.screen_res_y = screen_size.y;
+  cfg.particles_x = grid_size.x;
+  cfg.particles_y = grid_size.y;
+  return cfg;
+}
+
+// ================================== Golden files ==================================
+
+// Binary PPM, top row first, from pixels bottom row first as GL reads them
+bool write_ppm(const std::filesystem::path& path, Resolution size, std::span<const unsigned char> pixels) {
+  std::ofstream file(path, std::ios::binary);
+  file << "P6\n" << size.x << ' ' << size.y << "\n255\n";
+  const size_t row_bytes = 3 * size_t{size.x};
+  for (unsigned y = size.y; y-- > 0;) {
+    file.write(reinterpret_cast<const char*>(pixels.data() + y * row_bytes), row_bytes);
+  }
+  return bool(file);
+}
+
+// Only PPMs as `write_ppm` writes them. Empty if there is none of `size`
+std::vector<unsigned char> read_ppm(const std::filesystem::path& path, Resolution size) {
+  std::ifstream file(path, std::ios::binary);
+  std::string magic;
+  unsigned width = 0, height = 0, max_value = 0;
+  file >> magic >> width >> height >> max_value;
+  file.get();
+  if (!file || magic != "P6" || width != size.x || height != size.y || max_value != 255) {
+    return {};
+  }
+  const size_t row_bytes = 3 * size_t{size.x};
+  std::vector<unsigned char> pixels(row_bytes * size.y);
+  for (unsigned y = size.y; y-- > 0;) {
+    file.read(reinterpret_cast<char*>(pixels.data() + y * row_bytes), row_bytes);
+  }
+  return file ? pixels : std::vector<unsigned char>{};
+}
+
+std::map<std::string, double> read_baselines(const std::filesystem::path& path) {
+  std::map<std::string, double> baselines;
+  std::ifstream file(path);
+  std::string name;
+  for (double ticks_per_second; file >> name >> ticks_per_second;) {
+    baselines[name] = ticks_per_second;
+  }
+  return baselines;
+}
+
+bool write_baselines(const std::filesystem::path& path, const std::map<std::string, double>& baselines) {
+  std::ofstream file(path);
+  for (const auto& [name, ticks_per_second]: baselines) {
+    file << name << ' ' << ticks_per_second << '\n';
+  }
+  return bool(file);
+}
+
+// =================================== Comparison ===================================
+
+struct Difference {
+  size_t num_differing = 0;
+  size_t num_total = 0;
+  double max = 0;
+
+  [[nodiscard]] bool is_within(double max_differing_fraction) const {
+    return num_differing <= max_differing_fraction * num_total;
+  }
+};
+
+Difference compare_images(std::span<const unsigned char> expected, std::span<const unsigned char> actual) {
+  const image::Rgb_difference diff = image::compare_rgb(expected, actual, pixel_tolerance);
+  return {.num_differing = diff.num_differing, .num_total = diff.num_total, .max = double(diff.max)};
+}
+
+// Particles that are NaN (or infinitely far) in both are equal
+Difference compare_particles(std::span<const sim::Particle> expected, std::span<const sim::Particle> actual) {
+  Difference diff{.num_total = expected.size()};
+  for (size_t i = 0; i < expected.size(); i++) {
+    const sim::Particle& e = expected[i];
+    const sim::Particle& a = actual[i];
+    if (!std::isfinite(e.front.x + e.front.y) || !std::isfinite(a.front.x + a.front.y)) {
+      diff.num_differing += (std::isfinite(e.front.x + e.front.y) != std::isfinite(a.front.x + a.front.y));
+      continue;
+    }
+    const float distance = std::max(glm::distance(e.front, a.front), glm::distance(e.back, a.back));
+    diff.num_differing += (distance > position_tolerance);
+    diff.max = std::max(diff.max, double(distance));
+  }
+  return diff;
+}
+
+// ===================================== Cases =====================================
+
+bool run_golden_case(const Test_config& test_cfg, const Golden_case& c) {
+  gfx::Config cfg = get_gfx_config(golden_screen_size, golden_grid_size);
+  cfg.backend = c.backend;
+  cfg.renderer = c.renderer;
+  cfg.integrator = c.integrator;
+  cfg.field_bake_x = cfg.field_bake_y = c.field_bake_size;
+
+  std::vector<unsigned char> image;
+  std::vector<sim::Particle> particles;
+  {
+    gfx::Init_lock gfx_lock(cfg);
+    for (unsigned tick = 0; tick < golden_num_ticks; tick++) {
+      gfx::fieldviz_update();
+      gfx::fieldviz_draw(tick == 0);
+      gfx::present_frame();
+    }
+    image = gfx::fieldviz_read_image();
+    particles = gfx::fieldviz_read_particles();
+  }
+
+  const std::filesystem::path image_path =
+    test_cfg.golden_dir / fmt::format(FMT_STRING("{}.ppm"), c.name);
+  const std::filesystem::path particles_path =
+    test_cfg.golden_dir / fmt::format(FMT_STRING("{}.snap"), c.name);
+  const snapshot::State state = {
+    .grid_size = golden_grid_size,
+    .tick = golden_num_ticks,
+    .particle_lifetime = cfg.particle_lifetime,
+    .tick_rate = cfg.sim_rate,
+    .num_actors = cfg.num_actors,
+    .particles = particles,
+    .vortices = {},
+    .pushers = {},
+  };
+
+  if (test_cfg.update) {
+    std::filesystem::create_directories(test_cfg.golden_dir);
+    if (!write_ppm(image_path, golden_screen_size, image)
+        || !snapshot::write_file(particles_path.string(), state)) {
+      WARNING("{}: cannot write goldens to '{}'", c.name, test_cfg.golden_dir.string());
+      return false;
+    }
+    INFO("{}: updated goldens in '{}'", c.name, test_cfg.golden_dir.string());
+    return true;
+  }
+
+  const std::vector<unsigned char> expected_image = read_ppm(image_path, golden_screen_size);
+  if (expected_image.empty()) {
+    WARNING("{}: no golden image of {} in '{}'", c.name, golden_screen_size, image_path.string());
+    return false;
+  }
+  if (!std::filesystem::exists(particles_path)) {
+    WARNING("{}: no golden particles in '{}'", c.name, particles_path.string());
+    return false;
+  }
+  const snapshot::Mapped_snapshot expected_particles(particles_path.string());
+  if (expected_particles.get().grid_size != golden_grid_size) {
+    WARNING("{}: golden particles in '{}' are of another grid size", c.name, particles_path.string());
+    return false;
+  }
+
+  const Difference image_diff = compare_images(expected_image, image);
+  const Difference particles_diff = compare_particles(expected_particles.get().particles, particles);
+  const bool passed =
+    image_diff.is_within(max_differing_pixels) && particles_diff.is_within(max_differing_particles);
+  const auto message = fmt::format(
+    "{}: {} of {} pixels differ by more than {} (max {}), {} of {} particles by more than {} (max {:.3g})",
+    c.name,
+    image_diff.num_differing,
+    image_diff.num_total,
+    pixel_tolerance,
+    image_diff.max,
+    particles_diff.num_differing,
+    particles_diff.num_total,
+    position_tolerance,
+    particles_diff.max
+  );
+  if (passed) {
+    INFO("{}", message);
+  } else {
+    WARNING("{}", message);
+  }
+  return passed;
+}
+
+bool run_perf_case(const Test_config& test_cfg) {
+  double best_seconds = INFINITY;
+  for (int run = 0; run < perf_num_runs; run++) {
+    gfx::Init_lock gfx_lock(get_gfx_config(perf_screen_size, perf_grid_size));
+
+    // The first tick may include compiling the shaders for real
+    gfx::fieldviz_update();
+    gfx::fieldviz_draw(true);
+    gfx::present_frame();
+    gfx::wait_idle();
+
+    auto start = Clock::now();
+    for (unsigned tick = 0; tick < perf_num_ticks; tick++) {
+      gfx::fieldviz_update();
+      gfx::fieldviz_draw(false);
+      gfx::present_frame();
+    }
+    gfx::wait_idle();
+    best_seconds = std::min(best_seconds, std::chrono::duration<double>(Clock::now() - start).count());
+  }
+  const double ticks_per_second = perf_num_ticks / best_seconds;
+
+  const std::filesystem::path& baselines_path = test_cfg.baselines_path;
+  std::map<std::string, double> baselines = read_baselines(baselines_path);
+  const std::string name{perf_case_name};
+
+  const auto it = baselines.find(name);
+  if (test_cfg.update || it == baselines.end()) {
+    baselines[name] = ticks_per_second;
+    if (!write_baselines(baselines_path, baselines)) {
+      WARNING("{}: cannot write baseline to '{}'", name, baselines_path.string());
+      return false;
+    }
+    INFO("{}: recorded baseline of {:.1f} ticks/s in '{}'", name, ticks_per_second, baselines_path.string());
+    return true;
+  }
+  const double min_ticks_per_second = it->second * (1 - test_cfg.max_slowdown_percent / 100);
+  const bool passed = ticks_per_second >= min_ticks_per_second;
+  const auto message = fmt::format(
+    "{}: {:.1f} ticks/s, baseline {:.1f}, at least {:.1f} required",
+    name,
+    ticks_per_second,
+    it->second,
+    min_ticks_per_second
+  );
+  if (passed) {
+    INFO("{}", message);
+  } else {
+    WARNING("{}", message);
+  }
+  return passed;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  Test_config cfg;
+  std::vector<std::string_view> case_names;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    try {
+      if (arg == "--update") {
+        cfg.update = true;
+      } else if (arg.starts_with("--golden-dir=")) {
+        cfg.golden_dir = arg.substr(sizeof("--golden-dir=") - 1);
+      } else if (arg.starts_with("--baselines=")) {
+        cfg.baselines_path = arg.substr(sizeof("--baselines=") - 1);
+      } else if (arg.starts_with("--max-slowdown=")) {
+        arg::parse_number(arg.substr(sizeof("--max-slowdown=") - 1), cfg.max_slowdown_percent);
+      } else if (arg.starts_with("--")) {
+        throw arg::Arg_parse_exception{.subject = arg, .defect = "is not a valid option"};
+      } else {
+        case_names.push_back(arg);
+      }
+    } catch (arg::Arg_parse_exception& ex) {
+      FATAL("Bad argument '{}': '{}' {}", arg, ex.subject, ex.defect);
+    }
+  }
+
+  if (case_names.empty()) {
+    for (const Golden_case& c: golden_cases) {
+      case_names.push_back(c.name);
+    }
+    case_names.push_back(perf_case_name);
+  }
+
+  int num_failed = 0;
+  for (std::string_view name: case_names) {
+    const auto golden = std::ranges::find(golden_cases, name, &Golden_case::name);
+    if (golden != std::end(golden_cases)) {
+      num_failed += !run_golden_case(cfg, *golden);
+    } else if (name == perf_case_name) {
+      num_failed += !run_perf_case(cfg);
+    } else {
+      FATAL("There is no test case '{}'", name);
+    }
+  }
+  return num_failed > 0;
+}